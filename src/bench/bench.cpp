@@ -44,42 +44,60 @@ void benchmark::ConsolePrinter::result(const State& state)
 }
 
 void benchmark::ConsolePrinter::footer() {}
-benchmark::PlotlyPrinter::PlotlyPrinter(std::string plotly_url, int64_t width, int64_t height)
-    : m_plotly_url(plotly_url), m_width(width), m_height(height)
+benchmark::PlotlyPrinter::PlotlyPrinter(std::string plotly_url, int64_t width, int64_t height, std::ostream& os)
+    : m_plotly_url(plotly_url), m_width(width), m_height(height), m_os(os)
 {
 }
 
 void benchmark::PlotlyPrinter::header()
 {
-    std::cout << "<html><head>"
-              << "<script src=\"" << m_plotly_url << "\"></script>"
-              << "</head><body><div id=\"myDiv\" style=\"width:" << m_width << "px; height:" << m_height << "px\"></div>"
-              << "<script> var data = ["
-              << std::endl;
+    m_os << "<html><head>"
+         << "<script src=\"" << m_plotly_url << "\"></script>"
+         << "</head><body><div id=\"myDiv\" style=\"width:" << m_width << "px; height:" << m_height << "px\"></div>"
+         << "<script> var data = ["
+         << std::endl;
 }
 
 void benchmark::PlotlyPrinter::result(const State& state)
 {
-    std::cout << "{ " << std::endl
-              << "  name: '" << state.m_name << "', " << std::endl
-              << "  y: [";
+    m_os << "{ " << std::endl
+         << "  name: '" << state.m_name << "', " << std::endl
+         << "  y: [";
 
     const char* prefix = "";
     for (const auto& e : state.m_elapsed_results) {
-        std::cout << prefix << std::setprecision(6) << e;
+        m_os << prefix << std::setprecision(6) << e;
         prefix = ", ";
     }
-    std::cout << "]," << std::endl
-              << "  boxpoints: 'all', jitter: 0.3, pointpos: 0, type: 'box',"
-              << std::endl
-              << "}," << std::endl;
+    m_os << "]," << std::endl
+         << "  boxpoints: 'all', jitter: 0.3, pointpos: 0, type: 'box',"
+         << std::endl
+         << "}," << std::endl;
 }
 
 void benchmark::PlotlyPrinter::footer()
 {
-    std::cout << "]; var layout = { showlegend: false, yaxis: { rangemode: 'tozero', autorange: true } };"
-              << "Plotly.newPlot('myDiv', data, layout);"
-              << "</script></body></html>";
+    m_os << "]; var layout = { showlegend: false, yaxis: { rangemode: 'tozero', autorange: true } };"
+         << "Plotly.newPlot('myDiv', data, layout);"
+         << "</script></body></html>";
+}
+
+void benchmark::MultiPrinter::header()
+{
+    for (Printer* printer : m_printers)
+        printer->header();
+}
+
+void benchmark::MultiPrinter::result(const State& state)
+{
+    for (Printer* printer : m_printers)
+        printer->result(state);
+}
+
+void benchmark::MultiPrinter::footer()
+{
+    for (Printer* printer : m_printers)
+        printer->footer();
 }
 
 
@@ -6,6 +6,7 @@
 #define BITCOIN_BENCH_BENCH_H
 
 #include <functional>
+#include <iostream>
 #include <limits>
 #include <map>
 #include <string>
@@ -120,7 +121,7 @@ public:
 class PlotlyPrinter : public Printer
 {
 public:
-    PlotlyPrinter(std::string plotly_url, int64_t width, int64_t height);
+    PlotlyPrinter(std::string plotly_url, int64_t width, int64_t height, std::ostream& os = std::cout);
     void header();
     void result(const State& state);
     void footer();
@@ -129,6 +130,20 @@ private:
     std::string m_plotly_url;
     int64_t m_width;
     int64_t m_height;
+    std::ostream& m_os;
+};
+
+// passes the results of one run on to several printers
+class MultiPrinter : public Printer
+{
+public:
+    explicit MultiPrinter(std::vector<Printer*> printers) : m_printers(printers) {}
+    void header();
+    void result(const State& state);
+    void footer();
+
+private:
+    std::vector<Printer*> m_printers;
 };
 }
 
@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 
 #include <crypto/sha256.h>
+#include <crypto/yespower.h>
 #include <key.h>
 #include <validation.h>
 #include <util.h>
@@ -12,6 +13,8 @@
 
 #include <boost/lexical_cast.hpp>
 
+#include <fstream>
+#include <iostream>
 #include <memory>
 
 static const int64_t DEFAULT_BENCH_EVALUATIONS = 5;
@@ -37,12 +40,15 @@ main(int argc, char** argv)
                   << HelpMessageOpt("-printer=(console|plot)", strprintf(_("Choose printer format. console: print data to console. plot: Print results as HTML graph (default: %s)"), DEFAULT_BENCH_PRINTER))
                   << HelpMessageOpt("-plot-plotlyurl=<uri>", strprintf(_("URL to use for plotly.js (default: %s)"), DEFAULT_PLOT_PLOTLYURL))
                   << HelpMessageOpt("-plot-width=<x>", strprintf(_("Plot width in pixel (default: %u)"), DEFAULT_PLOT_WIDTH))
-                  << HelpMessageOpt("-plot-height=<x>", strprintf(_("Plot height in pixel (default: %u)"), DEFAULT_PLOT_HEIGHT));
+                  << HelpMessageOpt("-plot-height=<x>", strprintf(_("Plot height in pixel (default: %u)"), DEFAULT_PLOT_HEIGHT))
+                  << HelpMessageOpt("-plot-output=<file>", _("Also write the results of the same run as HTML graph to <file>"));
 
         return 0;
     }
 
     SHA256AutoDetect();
+    // Report on stderr so console/plot output stays machine-readable.
+    std::cerr << "Using the '" << YespowerAutoDetect() << "' yespower implementation" << std::endl;
     RandomInit();
     ECC_Start();
     SetupEnvironment();
@@ -65,7 +71,29 @@ main(int argc, char** argv)
             gArgs.GetArg("-plot-height", DEFAULT_PLOT_HEIGHT)));
     }
 
-    benchmark::BenchRunner::RunAll(*printer, evaluations, scaling_factor, regex_filter, is_list_only);
+    // A second run would give different numbers, so a plot of the same
+    // run is written next to the chosen output.
+    benchmark::Printer* run_printer = printer.get();
+    std::ofstream plot_file;
+    std::unique_ptr<benchmark::Printer> plot_printer;
+    std::unique_ptr<benchmark::Printer> multi_printer;
+    if (gArgs.IsArgSet("-plot-output")) {
+        std::string plot_path = gArgs.GetArg("-plot-output", "");
+        plot_file.open(plot_path);
+        if (!plot_file) {
+            std::cerr << "Unable to open " << plot_path << std::endl;
+            return 1;
+        }
+        plot_printer.reset(new benchmark::PlotlyPrinter(
+            gArgs.GetArg("-plot-plotlyurl", DEFAULT_PLOT_PLOTLYURL),
+            gArgs.GetArg("-plot-width", DEFAULT_PLOT_WIDTH),
+            gArgs.GetArg("-plot-height", DEFAULT_PLOT_HEIGHT),
+            plot_file));
+        multi_printer.reset(new benchmark::MultiPrinter({printer.get(), plot_printer.get()}));
+        run_printer = multi_printer.get();
+    }
+
+    benchmark::BenchRunner::RunAll(*run_printer, evaluations, scaling_factor, regex_filter, is_list_only);
 
     ECC_Stop();
 }
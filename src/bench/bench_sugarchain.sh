@@ -1,2 +1 @@
-./bench_sugarchain -printer=console > ./result/bench_sugarchain.txt
-./bench_sugarchain -printer=plot > ./result/bench_sugarchain.html
+./bench_sugarchain -printer=console -plot-output=./result/bench_sugarchain.html > ./result/bench_sugarchain.txt
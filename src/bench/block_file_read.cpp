@@ -0,0 +1,65 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <blockfilemap.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <fs.h>
+#include <primitives/block.h>
+#include <streams.h>
+
+#include <assert.h>
+#include <vector>
+
+// Most blocks on a 5 second chain hold little more than their coinbase, so
+// the per-read cost of getting at the file dominates reading them.
+static const int BLOCKS_PER_ITERATION = 1000;
+
+/** A block file holding BLOCKS_PER_ITERATION copies of the genesis block; returns their positions. */
+static std::vector<unsigned int> WriteBlockFile(const fs::path& path)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    std::vector<unsigned int> vPos;
+    CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+    assert(!fileout.IsNull());
+    const CBlock& genesis = Params().GenesisBlock();
+    for (int i = 0; i < BLOCKS_PER_ITERATION; i++) {
+        fileout << FLATDATA(Params().MessageStart()) << (unsigned int)GetSerializeSize(fileout, genesis);
+        vPos.push_back(ftell(fileout.Get()));
+        fileout << genesis;
+    }
+    return vPos;
+}
+
+static void ReadBlocks(benchmark::State& state, bool fMapped)
+{
+    const fs::path path = fs::temp_directory_path() / fs::unique_path();
+    const std::vector<unsigned int> vPos = WriteBlockFile(path);
+    CBlockFileMap map(1);
+    while (state.KeepRunning()) {
+        for (unsigned int nPos : vPos) {
+            CBlock block;
+            if (fMapped) {
+                std::shared_ptr<const CMappedFile> mapped = map.Get(path, nPos);
+                assert(mapped);
+                CMemoryReader reader(SER_DISK, CLIENT_VERSION, mapped->data() + nPos, mapped->data() + mapped->size());
+                reader >> block;
+            } else {
+                // What OpenBlockFile does for every read
+                CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+                assert(!filein.IsNull() && fseek(filein.Get(), nPos, SEEK_SET) == 0);
+                filein >> block;
+            }
+        }
+    }
+    fs::remove(path);
+}
+
+static void ReadBlocksStdio(benchmark::State& state) { ReadBlocks(state, false); }
+static void ReadBlocksMapped(benchmark::State& state) { ReadBlocks(state, true); }
+
+BENCHMARK(ReadBlocksStdio, 20);
+BENCHMARK(ReadBlocksMapped, 20);
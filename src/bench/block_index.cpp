@@ -0,0 +1,148 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/datadir.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <memusage.h>
+#include <random.h>
+#include <txdb.h>
+#include <util.h>
+#include <validation.h>
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Number of entries created per iteration, roughly one week of 5-second blocks.
+static const size_t BLOCK_INDEX_ENTRIES = 120000;
+
+/**
+ * Report the memory the block index takes per entry, once per bench. It goes
+ * to stderr so that the console and plot output stay machine-readable.
+ */
+static void ReportUsage(const benchmark::State& state, const std::string& what, size_t nUsage, size_t nEntries)
+{
+    static std::set<std::string> setReported;
+    if (!setReported.insert(state.m_name + what).second) return;
+    std::cerr << state.m_name << ": " << std::fixed << std::setprecision(1) << (double)nUsage / nEntries
+              << " bytes per CBlockIndex for " << what << " (sizeof(CBlockIndex) = " << sizeof(CBlockIndex) << ")" << std::endl;
+}
+
+static void BlockIndexHeapAlloc(benchmark::State& state)
+{
+    std::vector<std::unique_ptr<CBlockIndex>> entries;
+    entries.reserve(BLOCK_INDEX_ENTRIES);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < BLOCK_INDEX_ENTRIES; i++) {
+            entries.emplace_back(new CBlockIndex());
+            entries.back()->nHeight = i;
+        }
+        ReportUsage(state, "the entries", entries.size() * memusage::DynamicUsage(entries.back()), entries.size());
+        entries.clear();
+    }
+}
+
+static void BlockIndexArenaAlloc(benchmark::State& state)
+{
+    CBlockIndexArena arena;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < BLOCK_INDEX_ENTRIES; i++) {
+            arena.Allocate()->nHeight = i;
+        }
+        assert(arena.Size() == BLOCK_INDEX_ENTRIES);
+        ReportUsage(state, "the entries", arena.DynamicMemoryUsage(), arena.Size());
+        arena.Clear();
+    }
+}
+
+// Size of the synthetic block index loaded at startup, about two months of 5-second blocks.
+static const int LOAD_BLOCK_INDEX_ENTRIES = 1000000;
+
+/** In-memory block tree DB holding a synthetic chain of LOAD_BLOCK_INDEX_ENTRIES headers. */
+static CBlockTreeDB& SyntheticBlockTree()
+{
+    static std::unique_ptr<CBlockTreeDB> blocktree;
+    if (blocktree) return *blocktree;
+
+    {
+        BenchDatadir datadir;
+        blocktree.reset(new CBlockTreeDB(nMaxBlockDBCache << 20, true));
+    }
+
+    FastRandomContext rng(true);
+    std::vector<uint256> hashes(LOAD_BLOCK_INDEX_ENTRIES);
+    std::vector<CBlockIndex> entries(LOAD_BLOCK_INDEX_ENTRIES);
+    std::vector<const CBlockIndex*> batch;
+    for (int i = 0; i < LOAD_BLOCK_INDEX_ENTRIES; i++) {
+        CBlockIndex& entry = entries[i];
+        entry.pprev = i ? &entries[i - 1] : nullptr;
+        entry.nHeight = i;
+        entry.nStatus = BLOCK_VALID_SCRIPTS | BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO;
+        entry.nTx = 1 + rng.randrange(8);
+        entry.nFile = i / 20000;
+        entry.nDataPos = rng.rand32() >> 5;
+        entry.nUndoPos = rng.rand32() >> 5;
+        entry.nVersion = 0x20000000;
+        entry.hashMerkleRoot = rng.rand256();
+        entry.nTime = 1564991200 + i * 5;
+        entry.nBits = 0x1f07ffff;
+        entry.nNonce = rng.rand32();
+        // Records are keyed by the header hash, which the loader recomputes.
+        hashes[i] = entry.GetBlockHeader().GetHash();
+        entry.phashBlock = &hashes[i];
+        batch.push_back(&entry);
+        if (batch.size() == 100000 || i == LOAD_BLOCK_INDEX_ENTRIES - 1) {
+            blocktree->WriteBatchSync({}, 0, batch);
+            batch.clear();
+        }
+    }
+    // Move everything out of the memtable so size estimates see it.
+    blocktree->CompactRange('b', 'c');
+    return *blocktree;
+}
+
+static void LoadBlockIndex(benchmark::State& state, bool fReserve)
+{
+    CBlockTreeDB& blocktree = SyntheticBlockTree();
+    while (state.KeepRunning()) {
+        BlockMap map;
+        CBlockIndexArena arena;
+        if (fReserve)
+            map.reserve(blocktree.EstimateBlockIndexEntries());
+        auto insertBlockIndex = [&](const uint256& hash) -> CBlockIndex* {
+            if (hash.IsNull()) return nullptr;
+            BlockMap::iterator mi = map.find(hash);
+            if (mi != map.end()) return mi->second;
+            CBlockIndex* pindexNew = arena.Allocate();
+            mi = map.insert(std::make_pair(hash, pindexNew)).first;
+            pindexNew->phashBlock = &mi->first;
+            return pindexNew;
+        };
+        bool ret = blocktree.LoadBlockIndexGuts(Params().GetConsensus(), insertBlockIndex);
+        assert(ret && map.size() == (size_t)LOAD_BLOCK_INDEX_ENTRIES);
+        ReportUsage(state, "the entries", arena.DynamicMemoryUsage(), map.size());
+        ReportUsage(state, "mapBlockIndex", memusage::DynamicUsage(map), map.size());
+    }
+}
+
+static void LoadBlockIndexGuts(benchmark::State& state)
+{
+    LoadBlockIndex(state, true);
+}
+
+static void LoadBlockIndexGutsNoReserve(benchmark::State& state)
+{
+    LoadBlockIndex(state, false);
+}
+
+BENCHMARK(BlockIndexHeapAlloc, 10);
+BENCHMARK(BlockIndexArenaAlloc, 10);
+BENCHMARK(LoadBlockIndexGuts, 1);
+BENCHMARK(LoadBlockIndexGutsNoReserve, 1);
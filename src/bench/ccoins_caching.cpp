@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <wallet/crypter.h>
 
 #include <vector>
@@ -84,4 +85,87 @@ static void CCoinsCaching(benchmark::State& state)
     }
 }
 
+static const int CACHE_BENCH_COINS = 200000;
+
+static Coin RandomCoin(FastRandomContext& rng)
+{
+    Coin coin;
+    coin.out.nValue = 1 + rng.randrange(COIN);
+    coin.out.scriptPubKey.assign(1 + rng.randbits(5), 0);
+    coin.nHeight = 1 + rng.randrange(400000);
+    return coin;
+}
+
+// Lookups spread over a cache far larger than the CPU caches, where the cost
+// is in chasing pointers to the nodes rather than in the accounting.
+static void CCoinsCachingLarge(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins(&coinsDummy);
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(CACHE_BENCH_COINS);
+    for (int i = 0; i < CACHE_BENCH_COINS; i++) {
+        outpoints.emplace_back(rng.rand256(), 0);
+        coins.AddCoin(outpoints.back(), RandomCoin(rng), false);
+    }
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        i = (i + 7919) % outpoints.size();
+        bool spent = coins.AccessCoin(outpoints[i]).IsSpent();
+        assert(!spent);
+    }
+}
+
+/** Coins view that accepts and drops whatever is written to it, standing in for the chainstate DB. */
+class CCoinsViewSink : public CCoinsView
+{
+public:
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase) override
+    {
+        if (erase)
+            mapCoins.clear();
+        return true;
+    }
+};
+
+// The cache traffic of connecting blocks during IBD: each block spends coins
+// created by earlier blocks and adds its own in a view on top of the tip
+// cache, which takes the changes on Flush and is written out every so often.
+static void CCoinsConnectBlocks(benchmark::State& state)
+{
+    const int BLOCKS = 100;
+    const int COINS_PER_BLOCK = 2000;
+    const int BLOCKS_PER_TIP_FLUSH = 40;
+
+    while (state.KeepRunning()) {
+        FastRandomContext rng(true);
+        CCoinsViewSink sink;
+        CCoinsViewCache tip(&sink);
+        std::vector<COutPoint> vUnspent;
+        for (int nBlock = 0; nBlock < BLOCKS; nBlock++) {
+            CCoinsViewCache view(&tip);
+            // Spend coins of the last few blocks, as most inputs do
+            for (int i = 0; i < COINS_PER_BLOCK / 2 && !vUnspent.empty(); i++) {
+                size_t n = vUnspent.size() - 1 - rng.randrange(std::min<size_t>(vUnspent.size(), 4 * COINS_PER_BLOCK));
+                view.AccessCoin(vUnspent[n]);
+                view.SpendCoin(vUnspent[n]);
+                vUnspent[n] = vUnspent.back();
+                vUnspent.pop_back();
+            }
+            for (int i = 0; i < COINS_PER_BLOCK; i++) {
+                vUnspent.emplace_back(rng.rand256(), i % 2);
+                view.AddCoin(vUnspent.back(), RandomCoin(rng), false);
+            }
+            view.SetBestBlock(rng.rand256());
+            view.Flush();
+            if (nBlock % BLOCKS_PER_TIP_FLUSH == BLOCKS_PER_TIP_FLUSH - 1)
+                tip.Flush();
+        }
+    }
+}
+
 BENCHMARK(CCoinsCaching, 170 * 1000);
+BENCHMARK(CCoinsCachingLarge, 2 * 1000 * 1000);
+BENCHMARK(CCoinsConnectBlocks, 2);
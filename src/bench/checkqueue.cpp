@@ -21,7 +21,7 @@ static const unsigned int QUEUE_BATCH_SIZE = 128;
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
 // and there is a little bit of work done between calls to Add.
-static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+static void CCheckQueueSpeed(benchmark::State& state, int nThreads)
 {
     struct PrevectorJob {
         prevector<PREVECTOR_SIZE, uint8_t> p;
@@ -38,7 +38,7 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     };
     CCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
-    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+    for (auto x = 0; x < nThreads; ++x) {
        tg.create_thread([&]{queue.Thread();});
     }
     while (state.KeepRunning()) {
@@ -59,4 +59,26 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+{
+    CCheckQueueSpeed(state, std::max(MIN_CORES, GetNumCores()));
+}
+
+// Scaling curve of the same workload, by number of worker threads
+static void CCheckQueueSpeedPrevectorJob1(benchmark::State& state) { CCheckQueueSpeed(state, 1); }
+static void CCheckQueueSpeedPrevectorJob2(benchmark::State& state) { CCheckQueueSpeed(state, 2); }
+static void CCheckQueueSpeedPrevectorJob4(benchmark::State& state) { CCheckQueueSpeed(state, 4); }
+static void CCheckQueueSpeedPrevectorJob8(benchmark::State& state) { CCheckQueueSpeed(state, 8); }
+static void CCheckQueueSpeedPrevectorJob16(benchmark::State& state) { CCheckQueueSpeed(state, 16); }
+static void CCheckQueueSpeedPrevectorJob32(benchmark::State& state) { CCheckQueueSpeed(state, 32); }
+static void CCheckQueueSpeedPrevectorJob64(benchmark::State& state) { CCheckQueueSpeed(state, 64); }
+
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob1, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob2, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob4, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob8, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob16, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob32, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob64, 1400);
@@ -0,0 +1,105 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/datadir.h>
+
+#include <checkqueue.h>
+#include <coins.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <streams.h>
+#include <txdb.h>
+#include <util.h>
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+namespace block_bench {
+#include <bench/data/block413567.raw.h>
+} // namespace block_bench
+
+/** The outpoints the stored block spends from earlier blocks, as ConnectBlock collects them. */
+static std::vector<COutPoint> BlockPrevouts()
+{
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    std::set<uint256> setBlockTxids;
+    std::vector<COutPoint> vPrevouts;
+    for (const auto& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const CTxIn& txin : tx->vin) {
+                if (!setBlockTxids.count(txin.prevout.hash))
+                    vPrevouts.push_back(txin.prevout);
+            }
+        }
+        setBlockTxids.insert(tx->GetHash());
+    }
+    return vPrevouts;
+}
+
+/** In-memory chainstate DB holding a coin for every input of the stored block. */
+static CCoinsViewDB& BlockChainstate(const std::vector<COutPoint>& vPrevouts)
+{
+    static std::unique_ptr<CCoinsViewDB> chainstate;
+    if (chainstate) return *chainstate;
+
+    {
+        BenchDatadir datadir;
+        chainstate.reset(new CCoinsViewDB(nMaxCoinsDBCache << 20, true));
+    }
+
+    FastRandomContext rng(true);
+    CCoinsViewCache cache(chainstate.get());
+    for (const COutPoint& prevout : vPrevouts) {
+        Coin coin;
+        coin.out.nValue = 1 + rng.randrange(COIN);
+        coin.out.scriptPubKey.assign(1 + rng.randbits(5), 0);
+        coin.nHeight = 1 + rng.randrange(400000);
+        cache.AddCoin(prevout, std::move(coin), true);
+    }
+    cache.SetBestBlock(rng.rand256());
+    bool ret = cache.Flush();
+    assert(ret);
+    return *chainstate;
+}
+
+// Resolve the inputs of a stored block against a cold coins cache, one by one
+// as the connect loop does, or after prefetching them as ConnectBlock now does.
+static void ConnectBlockInputs(benchmark::State& state, bool fPrefetch)
+{
+    const std::vector<COutPoint> vPrevouts = BlockPrevouts();
+    CCoinsViewDB& chainstate = BlockChainstate(vPrevouts);
+    // Workers like the -par threads the node reads the coins on
+    CCheckQueue<CCoinsFetch> queue(MIN_COINS_PER_FETCH_THREAD);
+    boost::thread_group tg;
+    for (int i = 0; i < std::max(GetNumCores() - 1, 1); i++)
+        tg.create_thread([&]{ queue.Thread(); });
+    while (state.KeepRunning()) {
+        CCoinsViewCache tip(&chainstate);
+        CCoinsViewCache view(&tip);
+        if (fPrefetch)
+            view.PrefetchCoins(vPrevouts, &queue);
+        for (const COutPoint& prevout : vPrevouts) {
+            bool spent = view.AccessCoin(prevout).IsSpent();
+            assert(!spent);
+        }
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void ConnectBlockInputsSerial(benchmark::State& state) { ConnectBlockInputs(state, false); }
+static void ConnectBlockInputsPrefetch(benchmark::State& state) { ConnectBlockInputs(state, true); }
+
+BENCHMARK(ConnectBlockInputsSerial, 20);
+BENCHMARK(ConnectBlockInputsPrefetch, 20);
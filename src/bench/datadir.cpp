@@ -0,0 +1,30 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/datadir.h>
+
+#include <chainparams.h>
+#include <random.h>
+#include <util.h>
+
+BenchDatadir::BenchDatadir()
+{
+    fPrevSet = gArgs.IsArgSet("-datadir");
+    strPrev = gArgs.GetArg("-datadir", "");
+    path = fs::temp_directory_path() / strprintf("bench_sugarchain_%lu", (unsigned long)GetRand(1ULL << 32));
+    fs::create_directories(path);
+    gArgs.ForceSetArg("-datadir", path.string());
+    ClearDatadirCache();
+    SelectParams(CBaseChainParams::REGTEST);
+}
+
+BenchDatadir::~BenchDatadir()
+{
+    if (fPrevSet)
+        gArgs.ForceSetArg("-datadir", strPrev);
+    else
+        gArgs.ClearArg("-datadir");
+    ClearDatadirCache();
+    fs::remove_all(path);
+}
@@ -0,0 +1,31 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_DATADIR_H
+#define BITCOIN_BENCH_DATADIR_H
+
+#include <fs.h>
+
+#include <string>
+
+/**
+ * Points -datadir at a fresh temporary directory while in scope, for
+ * benchmarks opening in-memory databases, which still resolve (and create)
+ * the data directory. The previous -datadir is restored and the directory
+ * removed on destruction. Regtest is selected and stays so, as for every
+ * other benchmark that needs chain parameters.
+ */
+class BenchDatadir
+{
+public:
+    BenchDatadir();
+    ~BenchDatadir();
+
+private:
+    fs::path path;
+    bool fPrevSet;
+    std::string strPrev;
+};
+
+#endif // BITCOIN_BENCH_DATADIR_H
@@ -0,0 +1,187 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <hash.h>
+#include <net.h>
+#include <net_processing.h>
+#include <netmessagemaker.h>
+#include <protocol.h>
+#include <random.h>
+#include <scheduler.h>
+#include <streams.h>
+#include <validation.h>
+
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Simulated inbound peers, each sending MESSAGES_PER_PEER messages per iteration.
+static const int SIMULATED_PEERS = 64;
+static const int MESSAGES_PER_PEER = 3;
+static const int INVS_PER_MESSAGE = 16;
+static const int ADDRS_PER_MESSAGE = 8;
+
+/** A message as it arrives off the wire: header, checksum and payload. */
+static std::vector<char> WireMessage(CSerializedNetMsg&& msg)
+{
+    std::vector<unsigned char> wire;
+    uint256 hash = Hash(msg.data.data(), msg.data.data() + msg.data.size());
+    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.data.size());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, wire, 0, hdr};
+    wire.insert(wire.end(), msg.data.begin(), msg.data.end());
+    return std::vector<char>(wire.begin(), wire.end());
+}
+
+/**
+ * A chain holding only the genesis block, a coins view with nothing in it,
+ * and SIMULATED_PEERS peers that have completed the version handshake.
+ */
+struct SimulatedPeers
+{
+    CCoinsView coinsDummy;
+    CScheduler scheduler;
+    std::unique_ptr<CConnman> connman;
+    std::unique_ptr<PeerLogicValidation> peerLogic;
+    std::unique_ptr<CBlockIndex> genesis;
+    uint256 hashGenesis;
+    std::vector<CNode*> nodes;
+    std::vector<std::vector<char>> vWire;
+
+    SimulatedPeers()
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        pcoinsTip.reset(new CCoinsViewCache(&coinsDummy));
+        genesis.reset(new CBlockIndex(Params().GenesisBlock()));
+        hashGenesis = Params().GenesisBlock().GetHash();
+        genesis->phashBlock = &hashGenesis;
+        chainActive.SetTip(genesis.get());
+        pindexBestHeader = genesis.get();
+
+        connman.reset(new CConnman(0x1337, 0x1337));
+        CConnman::Options options;
+        options.nSendBufferMaxSize = 1000 * DEFAULT_MAXSENDBUFFER;
+        options.nReceiveFloodSize = 1000 * DEFAULT_MAXRECEIVEBUFFER;
+        connman->Init(options);
+        peerLogic.reset(new PeerLogicValidation(connman.get(), scheduler));
+
+        for (int i = 0; i < SIMULATED_PEERS; i++) {
+            CAddress addr(CService(CNetAddr(), 18000 + i), NODE_NONE);
+            CNode* pnode = new CNode(i, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", /*fInboundIn=*/ true);
+            peerLogic->InitializeNode(pnode);
+            pnode->nVersion = PROTOCOL_VERSION;
+            pnode->SetSendVersion(PROTOCOL_VERSION);
+            pnode->fSuccessfullyConnected = true;
+            nodes.push_back(pnode);
+        }
+
+        // Every peer sends the same ping, tx inv and addr messages.
+        const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+        FastRandomContext rng(true);
+        std::vector<CInv> vInv;
+        for (int i = 0; i < INVS_PER_MESSAGE; i++)
+            vInv.emplace_back(MSG_TX, rng.rand256());
+        std::vector<CAddress> vAddr;
+        for (int i = 0; i < ADDRS_PER_MESSAGE; i++) {
+            CNetAddr ip;
+            ip.SetRaw(NET_IPV4, (const uint8_t*)"\x59\x2a\x00\x00");
+            CAddress addr(CService(ip, 34230 + i), NODE_NETWORK);
+            addr.nTime = GetAdjustedTime();
+            vAddr.push_back(addr);
+        }
+        vWire.push_back(WireMessage(msgMaker.Make(NetMsgType::PING, rng.rand64())));
+        vWire.push_back(WireMessage(msgMaker.Make(NetMsgType::INV, vInv)));
+        vWire.push_back(WireMessage(msgMaker.Make(NetMsgType::ADDR, vAddr)));
+        assert(vWire.size() == MESSAGES_PER_PEER);
+    }
+
+    ~SimulatedPeers()
+    {
+        for (CNode* pnode : nodes) {
+            bool fUpdateConnectionTime = false;
+            peerLogic->FinalizeNode(pnode->GetId(), fUpdateConnectionTime);
+            delete pnode;
+        }
+        peerLogic.reset();
+        connman.reset();
+        pindexBestHeader = nullptr;
+        chainActive.SetTip(nullptr);
+        pcoinsTip.reset();
+    }
+
+    /** What the socket handler does once a peer's messages are complete. */
+    void Receive()
+    {
+        for (CNode* pnode : nodes) {
+            LOCK(pnode->cs_vProcessMsg);
+            for (const std::vector<char>& wire : vWire) {
+                CNetMessage msg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+                int nHeader = msg.readHeader(wire.data(), wire.size());
+                msg.readData(wire.data() + nHeader, wire.size() - nHeader);
+                assert(msg.complete());
+                msg.nTime = GetTimeMicros();
+                pnode->nProcessQueueSize += msg.vRecv.size() + CMessageHeader::HEADER_SIZE;
+                pnode->vProcessMsg.push_back(std::move(msg));
+            }
+        }
+    }
+
+    /** One message handler thread's work on its shard, followed by the socket handler draining replies. */
+    void Handle(int nShard, int nShards)
+    {
+        std::atomic<bool> interrupt(false);
+        bool fMoreWork = true;
+        while (fMoreWork) {
+            fMoreWork = false;
+            for (CNode* pnode : nodes) {
+                if (pnode->GetId() % nShards != nShard)
+                    continue;
+                fMoreWork |= peerLogic->ProcessMessages(pnode, interrupt);
+                {
+                    LOCK(pnode->cs_sendProcessing);
+                    peerLogic->SendMessages(pnode, interrupt);
+                }
+                LOCK(pnode->cs_vSend);
+                pnode->vSendMsg.clear();
+                pnode->nSendSize = 0;
+                pnode->nSendOffset = 0;
+                pnode->fPauseSend = false;
+            }
+        }
+    }
+};
+
+static void ProcessMessagesThreads(benchmark::State& state, int nThreads)
+{
+    SimulatedPeers peers;
+    while (state.KeepRunning()) {
+        peers.Receive();
+        if (nThreads == 1) {
+            peers.Handle(0, 1);
+            continue;
+        }
+        std::vector<std::thread> threads;
+        for (int i = 0; i < nThreads; i++)
+            threads.emplace_back(&SimulatedPeers::Handle, &peers, i, nThreads);
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+    for (CNode* pnode : peers.nodes)
+        assert(pnode->vProcessMsg.empty() && !pnode->fDisconnect);
+}
+
+static void ProcessMessagesOneThread(benchmark::State& state) { ProcessMessagesThreads(state, 1); }
+static void ProcessMessagesTwoThreads(benchmark::State& state) { ProcessMessagesThreads(state, 2); }
+static void ProcessMessagesFourThreads(benchmark::State& state) { ProcessMessagesThreads(state, 4); }
+
+BENCHMARK(ProcessMessagesOneThread, 50);
+BENCHMARK(ProcessMessagesTwoThreads, 50);
+BENCHMARK(ProcessMessagesFourThreads, 50);
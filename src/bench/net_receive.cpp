@@ -0,0 +1,117 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chainparams.h>
+#include <hash.h>
+#include <net.h>
+#include <protocol.h>
+#include <streams.h>
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <assert.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace block_bench {
+#include <bench/data/block413567.raw.h>
+} // namespace block_bench
+
+// Block messages sent per iteration, as a peer serving IBD would stream them.
+static const int BLOCKS_PER_ITERATION = 16;
+
+/** BLOCKS_PER_ITERATION copies of a ~1MB block message as they appear on the wire. */
+static std::vector<char> BlockMessages()
+{
+    const char* pchBlock = (const char*)block_bench::block413567;
+    const size_t nBlockSize = sizeof(block_bench::block413567);
+    uint256 hash = Hash(pchBlock, pchBlock + nBlockSize);
+    CMessageHeader hdr(Params().MessageStart(), NetMsgType::BLOCK, nBlockSize);
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    std::vector<unsigned char> header;
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, header, 0, hdr};
+
+    std::vector<char> wire;
+    for (int i = 0; i < BLOCKS_PER_ITERATION; i++) {
+        wire.insert(wire.end(), header.begin(), header.end());
+        wire.insert(wire.end(), pchBlock, pchBlock + nBlockSize);
+    }
+    return wire;
+}
+
+/**
+ * The socket handler's receive loop, reduced to CNetMessage: either every
+ * byte goes through a 64KB buffer (fDirect false, the old behaviour), or
+ * large payload remainders are received straight into the message.
+ */
+static void ReceiveBlocks(int fd, bool fDirect)
+{
+    char pchBuf[0x10000];
+    std::unique_ptr<CNetMessage> msg(new CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+    int nReceived = 0;
+    while (nReceived < BLOCKS_PER_ITERATION) {
+        unsigned int nRemaining = msg->in_data ? msg->hdr.nMessageSize - msg->nDataPos : 0;
+        if (fDirect && nRemaining >= sizeof(pchBuf)) {
+            unsigned int nBytes = std::min(nRemaining, 256U * 1024);
+            char* pchDirect = msg->GetDataBuffer(nBytes);
+            ssize_t nRecv = recv(fd, pchDirect, nBytes, 0);
+            assert(nRecv > 0);
+            msg->DataReceived(nRecv);
+        } else {
+            ssize_t nRecv = recv(fd, pchBuf, sizeof(pchBuf), 0);
+            assert(nRecv > 0);
+            const char* pch = pchBuf;
+            while (nRecv > 0) {
+                int handled = msg->in_data ? msg->readData(pch, nRecv) : msg->readHeader(pch, nRecv);
+                assert(handled >= 0);
+                pch += handled;
+                nRecv -= handled;
+                if (msg->complete()) {
+                    nReceived++;
+                    msg.reset(new CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+                }
+            }
+            continue;
+        }
+        if (msg->complete()) {
+            nReceived++;
+            msg.reset(new CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+        }
+    }
+}
+
+static void NetReceiveBlocks(benchmark::State& state, bool fDirect)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const std::vector<char> wire = BlockMessages();
+    int fds[2];
+    int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(ret == 0);
+    while (state.KeepRunning()) {
+        std::thread sender([&wire, &fds] {
+            size_t nSent = 0;
+            while (nSent < wire.size()) {
+                ssize_t n = send(fds[0], wire.data() + nSent, wire.size() - nSent, 0);
+                assert(n > 0);
+                nSent += n;
+            }
+        });
+        ReceiveBlocks(fds[1], fDirect);
+        sender.join();
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void NetReceiveBlocksCopy(benchmark::State& state) { NetReceiveBlocks(state, false); }
+static void NetReceiveBlocksDirect(benchmark::State& state) { NetReceiveBlocks(state, true); }
+
+BENCHMARK(NetReceiveBlocksCopy, 20);
+BENCHMARK(NetReceiveBlocksDirect, 20);
+#endif // WIN32
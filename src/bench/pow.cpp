@@ -0,0 +1,104 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <pow.h>
+#include <random.h>
+#include <uint256.h>
+
+#include <vector>
+
+// Length of the synthetic chain walked per iteration, a few mainnet averaging windows.
+static const int POW_CHAIN_LENGTH = 4096;
+
+/** A chain of POW_CHAIN_LENGTH entries with random targets, 5-second blocks and a skip list. */
+struct SyntheticChain
+{
+    std::vector<CBlockIndex> blocks;
+    std::vector<uint256> hashes;
+
+    SyntheticChain() : blocks(POW_CHAIN_LENGTH), hashes(POW_CHAIN_LENGTH)
+    {
+        FastRandomContext rng(true);
+        for (int i = 0; i < POW_CHAIN_LENGTH; i++) {
+            hashes[i] = rng.rand256();
+            blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+            blocks[i].nHeight = i;
+            blocks[i].nTime = 1554336000 + i * 5 + rng.randrange(10);
+            blocks[i].nBits = 0x1f000000 | (rng.randbits(22) + 1);
+            blocks[i].phashBlock = &hashes[i];
+            blocks[i].BuildSkip();
+        }
+    }
+};
+
+/** Calls fn on every tip of the synthetic chain that has a full averaging window. */
+template <typename F>
+static void AveragingWindowBench(benchmark::State& state, F fn)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    SyntheticChain chain;
+
+    arith_uint256 bnTot;
+    while (state.KeepRunning()) {
+        for (int i = params.nPowAveragingWindow; i < POW_CHAIN_LENGTH; i++) {
+            fn(&chain.blocks[i], params, bnTot);
+        }
+    }
+}
+
+static void AveragingWindowFullWalk(benchmark::State& state)
+{
+    AveragingWindowBench(state, GetAveragingWindowSum);
+}
+
+static void AveragingWindowRolling(benchmark::State& state)
+{
+    AveragingWindowBench(state, GetAveragingWindowSumCached);
+}
+
+/**
+ * The time-dependent part of ContextualCheckBlockHeader for every header of
+ * the synthetic chain: the DigiShield retarget and the median time past rule.
+ */
+static void HeaderAcceptanceBench(benchmark::State& state, bool fCacheMedianTimePast)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    SyntheticChain chain;
+    if (fCacheMedianTimePast) {
+        for (CBlockIndex& index : chain.blocks)
+            index.BuildMedianTimePast();
+    }
+
+    uint64_t nAccepted = 0;
+    while (state.KeepRunning()) {
+        for (int i = 1; i < POW_CHAIN_LENGTH; i++) {
+            const CBlockIndex* pindexPrev = &chain.blocks[i - 1];
+            if (GetNextWorkRequired(pindexPrev, nullptr, params) && chain.blocks[i].GetBlockTime() > pindexPrev->GetMedianTimePast())
+                nAccepted++;
+        }
+    }
+    assert(nAccepted > 0);
+}
+
+static void HeaderAcceptanceMedianTimeUncached(benchmark::State& state)
+{
+    HeaderAcceptanceBench(state, false);
+}
+
+static void HeaderAcceptanceMedianTimeCached(benchmark::State& state)
+{
+    HeaderAcceptanceBench(state, true);
+}
+
+BENCHMARK(AveragingWindowFullWalk, 20);
+BENCHMARK(AveragingWindowRolling, 20);
+BENCHMARK(HeaderAcceptanceMedianTimeUncached, 100);
+BENCHMARK(HeaderAcceptanceMedianTimeCached, 100);
@@ -0,0 +1,164 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <crypto/yespower.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <uint256.h>
+#include <util.h>
+#include <version.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// Hashes computed by every thread per iteration of the scaling benchmarks.
+static const int HASHES_PER_THREAD = 4;
+
+static CBlockHeader SampleHeader()
+{
+    CBlockHeader header;
+    header.nVersion = 0x20000000;
+    header.hashPrevBlock = uint256S("be25b4a7c3d1c4cb144f578b0977922b0866e02d8a1327a432dc9fd90878d27c");
+    header.hashMerkleRoot = uint256S("8e0eb41c43c4a4931e28a8dc786342e3d9703be1896047565578b4090871f28d");
+    header.nTime = 1555935465;
+    header.nBits = 0x1f1cdd81;
+    header.nNonce = 0;
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    uint256 hash;
+    int ret = yespower_tls((const uint8_t *)&ss[0], ss.size(), &yespower_1_0_sugarchain, (yespower_binary_t *)&hash);
+    assert(ret == 0);
+    assert(hash == header.GetPoWHash());
+    return header;
+}
+
+static std::vector<unsigned char> SerializedHeader(const CBlockHeader& header)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+// The full CBlockHeaderUncached::GetPoWHash() path: serialization plus yespower_tls.
+static void YespowerGetPoWHash(benchmark::State& state)
+{
+    CBlockHeader header = SampleHeader();
+    while (state.KeepRunning()) {
+        header.nNonce++;
+        header.GetPoWHash();
+    }
+}
+
+// yespower_tls on a pre-serialized header, as GetPoWHash() uses it.
+static void YespowerTls(benchmark::State& state)
+{
+    std::vector<unsigned char> data = SerializedHeader(SampleHeader());
+    yespower_binary_t hash;
+    uint32_t nNonce = 0;
+    while (state.KeepRunning()) {
+        nNonce++;
+        memcpy(&data[76], &nNonce, sizeof(nNonce));
+        int ret = yespower_tls(data.data(), data.size(), &yespower_1_0_sugarchain, &hash);
+        assert(ret == 0);
+    }
+}
+
+// yespower with a caller-owned yespower_local_t, reused across hashes.
+static void YespowerLocal(benchmark::State& state)
+{
+    std::vector<unsigned char> data = SerializedHeader(SampleHeader());
+    yespower_local_t local;
+    int ret = yespower_init_local(&local);
+    assert(ret == 0);
+    yespower_binary_t hash;
+    uint32_t nNonce = 0;
+    while (state.KeepRunning()) {
+        nNonce++;
+        memcpy(&data[76], &nNonce, sizeof(nNonce));
+        ret = yespower(&local, data.data(), data.size(), &yespower_1_0_sugarchain, &hash);
+        assert(ret == 0);
+    }
+    yespower_free_local(&local);
+}
+
+// YespowerLocal with the scratch region on huge pages and pre-faulted.
+static void YespowerLocalHugePages(benchmark::State& state)
+{
+    YespowerSetHugePages(true);
+    YespowerLocal(state);
+    YespowerSetHugePages(false);
+}
+
+// Each thread hashes HASHES_PER_THREAD headers per iteration, so with perfect
+// scaling the time per iteration stays flat. The threads are short-lived and
+// yespower_tls() never frees a thread's scratch region, so they bring their
+// own yespower_local_t.
+static void YespowerScaling(benchmark::State& state, int nThreads)
+{
+    const std::vector<unsigned char> data = SerializedHeader(SampleHeader());
+    while (state.KeepRunning()) {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nThreads; t++) {
+            threads.emplace_back([&data, t] {
+                std::vector<unsigned char> work = data;
+                yespower_local_t local;
+                int ret = yespower_init_local(&local);
+                assert(ret == 0);
+                yespower_binary_t hash;
+                for (uint32_t nNonce = t * HASHES_PER_THREAD; nNonce < (uint32_t)(t + 1) * HASHES_PER_THREAD; nNonce++) {
+                    memcpy(&work[76], &nNonce, sizeof(nNonce));
+                    ret = yespower(&local, work.data(), work.size(), &yespower_1_0_sugarchain, &hash);
+                    assert(ret == 0);
+                }
+                yespower_free_local(&local);
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+}
+
+static void YespowerScaling1(benchmark::State& state) { YespowerScaling(state, 1); }
+static void YespowerScaling2(benchmark::State& state) { YespowerScaling(state, 2); }
+static void YespowerScaling4(benchmark::State& state) { YespowerScaling(state, 4); }
+static void YespowerScalingAllCores(benchmark::State& state) { YespowerScaling(state, std::max(1, GetNumCores())); }
+
+// GetPoWHash_cached() once the cache is warm: the block hash plus cache_lock.
+static void YespowerCachedHit(benchmark::State& state)
+{
+    const CBlockHeader header = SampleHeader();
+    header.GetPoWHash_cached();
+    while (state.KeepRunning()) {
+        header.GetPoWHash_cached();
+    }
+}
+
+// The CDataStream round trip GetPoWHash() pays before every hash.
+static void YespowerSerializeHeader(benchmark::State& state)
+{
+    CBlockHeader header = SampleHeader();
+    while (state.KeepRunning()) {
+        header.nNonce++;
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << header;
+        assert(ss.size() == 80);
+    }
+}
+
+BENCHMARK(YespowerGetPoWHash, 200);
+BENCHMARK(YespowerTls, 200);
+BENCHMARK(YespowerLocal, 200);
+BENCHMARK(YespowerLocalHugePages, 200);
+BENCHMARK(YespowerScaling1, 50);
+BENCHMARK(YespowerScaling2, 50);
+BENCHMARK(YespowerScaling4, 50);
+BENCHMARK(YespowerScalingAllCores, 50);
+BENCHMARK(YespowerCachedHit, 1000 * 1000);
+BENCHMARK(YespowerSerializeHeader, 5000 * 1000);
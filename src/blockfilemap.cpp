@@ -0,0 +1,86 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::shared_ptr<const CMappedFile> CMappedFile::Open(const fs::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return nullptr;
+    return std::shared_ptr<const CMappedFile>(new CMappedFile(static_cast<const unsigned char*>(p), st.st_size));
+#else
+    return nullptr;
+#endif
+}
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(pbegin), nSize);
+#endif
+}
+
+void CBlockFileMap::SetMaxFiles(size_t nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    while (lru.size() > nMaxFiles)
+        lru.pop_back();
+}
+
+std::shared_ptr<const CMappedFile> CBlockFileMap::Get(const fs::path& path, size_t nEnd)
+{
+    LOCK(cs);
+    if (nMaxFiles == 0)
+        return nullptr;
+
+    for (auto it = lru.begin(); it != lru.end(); ++it) {
+        if (it->first != path)
+            continue;
+        if (it->second->size() >= nEnd) {
+            lru.splice(lru.begin(), lru, it);
+            return it->second;
+        }
+        // The file has grown since it was mapped
+        lru.erase(it);
+        break;
+    }
+
+    std::shared_ptr<const CMappedFile> mapped = CMappedFile::Open(path);
+    if (!mapped)
+        return nullptr;
+    lru.emplace_front(path, mapped);
+    if (lru.size() > nMaxFiles)
+        lru.pop_back();
+    return mapped->size() >= nEnd ? mapped : nullptr;
+}
+
+void CBlockFileMap::Forget(const fs::path& path)
+{
+    LOCK(cs);
+    for (auto it = lru.begin(); it != lru.end(); ++it) {
+        if (it->first == path) {
+            lru.erase(it);
+            return;
+        }
+    }
+}
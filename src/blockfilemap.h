@@ -0,0 +1,71 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include <fs.h>
+#include <sync.h>
+
+#include <list>
+#include <memory>
+#include <stddef.h>
+#include <utility>
+
+/** Default for -mmapblockfiles; 32-bit builds keep the address space for other uses */
+static const int DEFAULT_MMAP_BLOCK_FILES = sizeof(void*) >= 8 ? 8 : 0;
+
+/** A whole file mapped read-only. It is unmapped when the last reference goes away. */
+class CMappedFile
+{
+public:
+    /** Map the file at path, or return nullptr if it is empty or can't be mapped (always on Windows). */
+    static std::shared_ptr<const CMappedFile> Open(const fs::path& path);
+
+    ~CMappedFile();
+    CMappedFile(const CMappedFile&) = delete;
+    CMappedFile& operator=(const CMappedFile&) = delete;
+
+    const unsigned char* data() const { return pbegin; }
+    size_t size() const { return nSize; }
+
+private:
+    CMappedFile(const unsigned char* pbeginIn, size_t nSizeIn) : pbegin(pbeginIn), nSize(nSizeIn) {}
+
+    const unsigned char* const pbegin;
+    const size_t nSize;
+};
+
+/**
+ * The most recently read blk?????.dat and rev?????.dat files, kept mapped so
+ * that reading a block or its undo data copies from the page cache instead of
+ * taking an fopen, fseek and fread per read.
+ *
+ * The last block file is appended to while mapped. A mapping that doesn't
+ * reach the requested end is replaced by one of the file's current size;
+ * readers still holding the old one keep it until they are done. Files must
+ * be forgotten before they are pruned or truncated.
+ */
+class CBlockFileMap
+{
+public:
+    explicit CBlockFileMap(size_t nMaxFilesIn = DEFAULT_MMAP_BLOCK_FILES) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Change how many files are kept mapped; 0 disables mapping. */
+    void SetMaxFiles(size_t nMaxFilesIn);
+
+    /** Return a mapping of path covering at least its first nEnd bytes, or nullptr. */
+    std::shared_ptr<const CMappedFile> Get(const fs::path& path, size_t nEnd);
+
+    /** Drop the mapping of path, if any. */
+    void Forget(const fs::path& path);
+
+private:
+    CCriticalSection cs;
+    size_t nMaxFiles;
+    //! Most recently used first
+    std::list<std::pair<fs::path, std::shared_ptr<const CMappedFile>>> lru;
+};
+
+#endif // BITCOIN_BLOCKFILEMAP_H
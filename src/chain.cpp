@@ -5,6 +5,8 @@
 
 #include <chain.h>
 
+#include <memusage.h>
+
 /**
  * CChain implementation
  */
@@ -118,6 +120,32 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+CBlockIndex* CBlockIndexArena::Allocate()
+{
+    if (nUsedInChunk == nChunkEntries) {
+        vChunks.emplace_back(new CBlockIndex[nChunkEntries]);
+        nUsedInChunk = 0;
+    }
+    return &vChunks.back()[nUsedInChunk++];
+}
+
+void CBlockIndexArena::Clear()
+{
+    vChunks.clear();
+    vChunks.shrink_to_fit();
+    nUsedInChunk = nChunkEntries;
+}
+
+size_t CBlockIndexArena::Size() const
+{
+    return vChunks.empty() ? 0 : (vChunks.size() - 1) * nChunkEntries + nUsedInChunk;
+}
+
+size_t CBlockIndexArena::DynamicMemoryUsage() const
+{
+    return vChunks.size() * memusage::MallocUsage(nChunkEntries * sizeof(CBlockIndex)) + memusage::DynamicUsage(vChunks);
+}
+
 arith_uint256 GetBlockProof(const CBlockIndex& block)
 {
     arith_uint256 bnTarget;
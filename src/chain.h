@@ -13,6 +13,7 @@
 #include <tinyformat.h>
 #include <uint256.h>
 
+#include <memory>
 #include <vector>
 
 /**
@@ -228,16 +229,15 @@ public:
     uint32_t nBits;
     uint32_t nNonce;
 
-    //! (currently memory only, but don't have to be)
-    bool cache_init;
-    uint256 cache_block_hash, cache_PoW_hash;
-
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     int32_t nSequenceId;
 
     //! (memory only) Maximum nTime in the chain up to and including this block.
     unsigned int nTimeMax;
 
+    //! (memory only) Median time past of this block, cached by BuildMedianTimePast (0 until then)
+    uint32_t nTimeMedian;
+
     void SetNull()
     {
         phashBlock = nullptr;
@@ -253,14 +253,13 @@ public:
         nStatus = 0;
         nSequenceId = 0;
         nTimeMax = 0;
+        nTimeMedian = 0;
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
         nTime          = 0;
         nBits          = 0;
         nNonce         = 0;
-
-        cache_init     = false;
     }
 
     CBlockIndex()
@@ -277,10 +276,6 @@ public:
         nTime          = block.nTime;
         nBits          = block.nBits;
         nNonce         = block.nNonce;
-
-        cache_init     = block.cache_init;
-        cache_block_hash = block.cache_block_hash;
-        cache_PoW_hash = block.cache_PoW_hash;
     }
 
     CDiskBlockPos GetBlockPos() const {
@@ -311,11 +306,6 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nNonce         = nNonce;
-
-        block.cache_init     = cache_init;
-        block.cache_block_hash = cache_block_hash;
-        block.cache_PoW_hash = cache_PoW_hash;
-
         return block;
     }
 
@@ -342,6 +332,19 @@ public:
     static constexpr int nMedianTimeSpan = 11;
 
     int64_t GetMedianTimePast() const
+    {
+        if (nTimeMedian)
+            return nTimeMedian;
+        return ComputeMedianTimePast();
+    }
+
+    //! Cache the median time past; the ancestors' timestamps never change once indexed.
+    void BuildMedianTimePast()
+    {
+        nTimeMedian = ComputeMedianTimePast();
+    }
+
+    int64_t ComputeMedianTimePast() const
     {
         int64_t pmedian[nMedianTimeSpan];
         int64_t* pbegin = &pmedian[nMedianTimeSpan];
@@ -394,6 +397,39 @@ public:
     const CBlockIndex* GetAncestor(int height) const;
 };
 
+/**
+ * Bump allocator for CBlockIndex entries. Entries in mapBlockIndex are only
+ * ever released all at once (UnloadBlockIndex), so they are carved out of
+ * large chunks instead of costing one heap allocation each.
+ */
+class CBlockIndexArena
+{
+private:
+    static constexpr size_t nChunkEntries = 4096;
+
+    std::vector<std::unique_ptr<CBlockIndex[]>> vChunks;
+
+    //! Number of entries handed out from the last chunk
+    size_t nUsedInChunk;
+
+public:
+    CBlockIndexArena() : nUsedInChunk(nChunkEntries) {}
+
+    CBlockIndexArena(const CBlockIndexArena&) = delete;
+    CBlockIndexArena& operator=(const CBlockIndexArena&) = delete;
+
+    //! Return a null entry that stays valid until Clear() is called.
+    CBlockIndex* Allocate();
+
+    //! Release every entry handed out so far.
+    void Clear();
+
+    //! Number of entries handed out.
+    size_t Size() const;
+
+    size_t DynamicMemoryUsage() const;
+};
+
 arith_uint256 GetBlockProof(const CBlockIndex& block);
 /** Return the time it would take to redo the work difference between from and to, assuming the current hashrate corresponds to the difficulty at tip, in seconds. */
 int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& from, const CBlockIndex& tip, const Consensus::Params&);
@@ -8,15 +8,22 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 
+//! Most threads, including the master, that may work on one CCheckQueue at a time
+static const int MAX_CHECKQUEUE_THREADS = 256;
+
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
   * operator(), returning a bool.
@@ -25,12 +32,144 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every thread owns a work-stealing deque of ranges of checks. The master
+  * pushes each batch onto its own deque without taking a lock, and idle
+  * threads steal the oldest ranges from the others. A thread splits a range
+  * it takes in halves, leaving the upper ones to be stolen, until it is no
+  * bigger than the batch size, or down to single checks while other threads
+  * are idle. The mutex is only used for threads going to sleep and waking up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! The checks [begin, end) of a batch that was added
+    struct Range
+    {
+        std::vector<T>* batch;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    /**
+     * Chase-Lev work-stealing deque of ranges (Le, Pop, Cohen and Zappa
+     * Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models").
+     * Only its owner pushes and takes at the bottom; any thread may steal
+     * from the top.
+     */
+    class RangeDeque
+    {
+    private:
+        struct Cell
+        {
+            std::atomic<std::vector<T>*> batch{nullptr};
+            std::atomic<uint32_t> begin{0};
+            std::atomic<uint32_t> end{0};
+        };
+
+        struct Array
+        {
+            const int64_t nSize; //!< a power of two
+            std::unique_ptr<Cell[]> cells;
+
+            explicit Array(int64_t nSizeIn) : nSize(nSizeIn), cells(new Cell[nSizeIn]) {}
+
+            void Put(int64_t i, const Range& range)
+            {
+                Cell& cell = cells[i & (nSize - 1)];
+                cell.batch.store(range.batch, std::memory_order_relaxed);
+                cell.begin.store(range.begin, std::memory_order_relaxed);
+                cell.end.store(range.end, std::memory_order_relaxed);
+            }
+
+            Range Get(int64_t i) const
+            {
+                const Cell& cell = cells[i & (nSize - 1)];
+                return Range{cell.batch.load(std::memory_order_relaxed), cell.begin.load(std::memory_order_relaxed), cell.end.load(std::memory_order_relaxed)};
+            }
+        };
+
+        std::atomic<int64_t> top{0};
+        std::atomic<int64_t> bottom{0};
+        std::atomic<Array*> array;
+        //! Every array ever used, as thieves may still read from an outgrown one
+        std::vector<std::unique_ptr<Array>> vArrays;
+
+    public:
+        RangeDeque()
+        {
+            vArrays.emplace_back(new Array(64));
+            array.store(vArrays.back().get(), std::memory_order_relaxed);
+        }
+
+        //! Push a range at the bottom. Owner only.
+        void Push(const Range& range)
+        {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            Array* a = array.load(std::memory_order_relaxed);
+            if (b - t > a->nSize - 1) {
+                Array* grown = new Array(a->nSize * 2);
+                for (int64_t i = t; i < b; i++)
+                    grown->Put(i, a->Get(i));
+                vArrays.emplace_back(grown);
+                array.store(grown, std::memory_order_release);
+                a = grown;
+            }
+            a->Put(b, range);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        //! Take the most recently pushed range. Owner only.
+        bool Take(Range& range)
+        {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            Array* a = array.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return false;
+            }
+            range = a->Get(b);
+            if (t == b) {
+                // Last one left; race thieves for it
+                bool fWon = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return fWon;
+            }
+            return true;
+        }
+
+        //! Steal the oldest range. Fails only if the deque is empty.
+        bool Steal(Range& range)
+        {
+            while (true) {
+                int64_t t = top.load(std::memory_order_acquire);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                int64_t b = bottom.load(std::memory_order_acquire);
+                if (t >= b)
+                    return false;
+                Array* a = array.load(std::memory_order_acquire);
+                range = a->Get(t);
+                if (top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    return true;
+                // Another thread took it; try the next one
+            }
+        }
+    };
+
+    //! A thread's deque; slot 0 belongs to whichever thread is the master
+    struct Slot
+    {
+        RangeDeque deque;
+        bool fInUse = false;
+    };
+
+    //! Mutex to protect sleeping and waking up, and slot registration
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,88 +178,120 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The slots of the master and of the workers, of which the first nSlots are allocated
+    std::unique_ptr<Slot> slots[MAX_CHECKQUEUE_THREADS];
+    std::atomic<int> nSlots{0};
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The batches added since the master last waited, owned by the master
+    std::vector<std::unique_ptr<std::vector<T>>> vBatches;
+
+    //! Bumped whenever a range is pushed, so threads going to sleep can tell they missed one
+    std::atomic<uint64_t> nPushed{0};
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of workers (including the master) that are idle.
+    std::atomic<int> nIdle{0};
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk{true};
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
+     * This includes elements that are no longer queued, but still being
+     * run or destroyed by a thread.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo{0};
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    /** Push a range onto a deque, and wake up threads that may steal it. */
+    void Push(Slot& slot, const Range& range)
+    {
+        slot.deque.Push(range);
+        nPushed++;
+        if (nIdle > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condWorker.notify_all();
+            condMaster.notify_one();
+        }
+    }
+
+    /** Take a range from the thread's own deque, or steal one from another. */
+    bool FindWork(int nSelf, Range& range)
+    {
+        if (slots[nSelf]->deque.Take(range))
+            return true;
+        int nCount = nSlots.load(std::memory_order_acquire);
+        for (int i = 1; i <= nCount; i++) {
+            if (slots[(nSelf + i) % nCount]->deque.Steal(range))
+                return true;
+        }
+        return false;
+    }
+
+    /** Run the checks of a range, after splitting off the parts others can take. */
+    void Run(int nSelf, Range range)
+    {
+        while (range.end - range.begin > nBatchSize || (range.end - range.begin > 1 && nIdle > 0)) {
+            uint32_t nMid = range.begin + (range.end - range.begin) / 2;
+            Push(*slots[nSelf], Range{range.batch, nMid, range.end});
+            range.end = nMid;
+        }
+        // Check whether we need to do work at all
+        bool fOk = fAllOk;
+        for (uint32_t i = range.begin; i < range.end; i++) {
+            // Swap each job out so it's destroyed before it's counted as done
+            T check;
+            check.swap((*range.batch)[i]);
+            if (fOk)
+                fOk = check();
+        }
+        if (!fOk)
+            fAllOk = false;
+        unsigned int nNow = range.end - range.begin;
+        if (nTodo.fetch_sub(nNow) == nNow) {
+            // We processed the last element; inform the master it can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condMaster.notify_one();
+        }
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(int nSelf, bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+        while (true) {
+            uint64_t nPushedSeen = nPushed;
+            Range range;
+            if (FindWork(nSelf, range)) {
+                Run(nSelf, range);
+                continue;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
-        } while (true);
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster && nTodo == 0) {
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                fAllOk = true;
+                vBatches.clear();
+                // return the current status
+                return fRet;
+            }
+            // Count ourselves idle before looking for missed pushes, so that
+            // whoever pushes after the check sees us and wakes us up.
+            nIdle++;
+            if (nPushed != nPushedSeen) {
+                nIdle--;
+                continue;
+            }
+            try {
+                cond.wait(lock); // wait
+            } catch (...) {
+                // interrupted
+                nIdle--;
+                throw;
+            }
+            nIdle--;
+        }
     }
 
 public:
@@ -128,33 +299,55 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nBatchSize(nBatchSizeIn)
+    {
+        slots[0].reset(new Slot());
+        slots[0]->fInUse = true;
+        nSlots.store(1, std::memory_order_release);
+    }
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        int nSelf;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            int nCount = nSlots.load(std::memory_order_relaxed);
+            for (nSelf = 1; nSelf < nCount && slots[nSelf]->fInUse; nSelf++);
+            assert(nSelf < MAX_CHECKQUEUE_THREADS);
+            if (nSelf == nCount) {
+                slots[nSelf].reset(new Slot());
+                nSlots.store(nCount + 1, std::memory_order_release);
+            }
+            slots[nSelf]->fInUse = true;
+        }
+        try {
+            Loop(nSelf);
+        } catch (...) {
+            // Workers only stop when interrupted while idle, so with an empty deque
+            boost::unique_lock<boost::mutex> lock(mutex);
+            slots[nSelf]->fInUse = false;
+            throw;
+        }
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+        std::unique_ptr<std::vector<T>> batch(new std::vector<T>(vChecks.size()));
+        for (size_t i = 0; i < vChecks.size(); i++)
+            (*batch)[i].swap(vChecks[i]);
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        Push(*slots[0], Range{batch.get(), 0, (uint32_t)batch->size()});
+        vBatches.push_back(std::move(batch));
     }
 
     ~CCheckQueue()
@@ -163,7 +356,7 @@ public:
 
 };
 
-/** 
+/**
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
  */
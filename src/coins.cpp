@@ -10,28 +10,48 @@
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
-bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return nullptr; }
 
+void CCoinsView::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins, CCheckQueue<CCoinsFetch>* pqueue) const
+{
+    coins.resize(outpoints.size());
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        if (!GetCoin(outpoints[i], coins[i]))
+            coins[i].Clear();
+    }
+}
+
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
 {
     Coin coin;
     return GetCoin(outpoint, coin);
 }
 
+bool CCoinsFetch::operator()()
+{
+    try {
+        if (!view->GetCoin(*outpoint, *coin))
+            coin->Clear();
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
 bool CCoinsViewBacked::GetCoin(const COutPoint &outpoint, Coin &coin) const { return base->GetCoin(outpoint, coin); }
 bool CCoinsViewBacked::HaveCoin(const COutPoint &outpoint) const { return base->HaveCoin(outpoint); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 std::vector<uint256> CCoinsViewBacked::GetHeadBlocks() const { return base->GetHeadBlocks(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) { return base->BatchWrite(mapCoins, hashBlock, erase); }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &cacheCoinsResource), cachedCoinsUsage(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -39,16 +59,19 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        it->second.flags |= CCoinsCacheEntry::USED;
         return it;
+    }
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(tmp))).first;
+    ret->second.flags = CCoinsCacheEntry::USED;
     if (ret->second.coin.IsSpent()) {
         // The parent only has an empty entry for this outpoint; we can consider our
         // version as fresh.
-        ret->second.flags = CCoinsCacheEntry::FRESH;
+        ret->second.flags |= CCoinsCacheEntry::FRESH;
     }
     cachedCoinsUsage += ret->second.coin.DynamicMemoryUsage();
     return ret;
@@ -63,6 +86,40 @@ bool CCoinsViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return false;
 }
 
+void CCoinsViewCache::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins, CCheckQueue<CCoinsFetch>* pqueue) const {
+    PrefetchCoins(outpoints, pqueue);
+    coins.resize(outpoints.size());
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        CCoinsMap::const_iterator it = cacheCoins.find(outpoints[i]);
+        if (it != cacheCoins.end())
+            coins[i] = it->second.coin;
+        else
+            coins[i].Clear();
+    }
+}
+
+void CCoinsViewCache::PrefetchCoins(const std::vector<COutPoint>& outpoints, CCheckQueue<CCoinsFetch>* pqueue) const {
+    std::vector<COutPoint> missing;
+    for (const COutPoint& outpoint : outpoints) {
+        if (!cacheCoins.count(outpoint))
+            missing.push_back(outpoint);
+    }
+    if (missing.empty())
+        return;
+    std::vector<Coin> fetched;
+    base->GetCoins(missing, fetched, pqueue);
+    for (size_t i = 0; i < missing.size(); i++) {
+        // As in FetchCoin, only coins the backing view has unspent are cached
+        if (fetched[i].IsSpent())
+            continue;
+        CCoinsMap::iterator it;
+        bool inserted;
+        std::tie(it, inserted) = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(missing[i]), std::forward_as_tuple(std::move(fetched[i])));
+        if (inserted)
+            cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+    }
+}
+
 void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possible_overwrite) {
     assert(!coin.IsSpent());
     if (coin.out.scriptPubKey.IsUnspendable()) return;
@@ -142,8 +199,8 @@ void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn) {
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = mapCoins.erase(it)) {
+bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn, bool erase) {
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
         // Ignore non-dirty entries (optimization).
         if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
             continue;
@@ -156,7 +213,10 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 // Otherwise we will need to create it in the parent
                 // and move the data up and mark it as dirty
                 CCoinsCacheEntry& entry = cacheCoins[it->first];
-                entry.coin = std::move(it->second.coin);
+                if (erase)
+                    entry.coin = std::move(it->second.coin);
+                else
+                    entry.coin = it->second.coin;
                 cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
                 entry.flags = CCoinsCacheEntry::DIRTY;
                 // We can mark it FRESH in the parent if it was FRESH in the child
@@ -185,7 +245,10 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
             } else {
                 // A normal modification.
                 cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
-                itUs->second.coin = std::move(it->second.coin);
+                if (erase)
+                    itUs->second.coin = std::move(it->second.coin);
+                else
+                    itUs->second.coin = it->second.coin;
                 cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
                 itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                 // NOTE: It is possible the child has a FRESH flag here in
@@ -204,13 +267,71 @@ bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
+    ReallocateCache();
     return fOk;
 }
 
+bool CCoinsViewCache::Sync()
+{
+    // The base writes the modified entries straight from the cache, which
+    // then drops the spent ones and keeps the rest, now in line with the base.
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, false);
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
+            ++it;
+        } else if (it->second.coin.IsSpent()) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+        } else {
+            it->second.flags &= CCoinsCacheEntry::USED;
+            ++it;
+        }
+    }
+    return fOk;
+}
+
+void CCoinsViewCache::Trim(size_t nTargetUsage)
+{
+    // A second-chance (clock) sweep over the map, carrying on where the last
+    // one stopped: used entries lose their mark and stay, modified ones stay
+    // as they are, and the rest are evicted. Every entry is passed at most
+    // twice, which bounds the sweep when only modified entries are left.
+    size_t nPassesLeft = 2 * cacheCoins.size();
+    CCoinsMap::iterator it = cacheCoins.find(clockHand);
+    while (!cacheCoins.empty() && nPassesLeft-- > 0 && DynamicMemoryUsage() > nTargetUsage) {
+        if (it == cacheCoins.end())
+            it = cacheCoins.begin();
+        if (it->second.flags & (CCoinsCacheEntry::USED | CCoinsCacheEntry::DIRTY)) {
+            it->second.flags &= ~CCoinsCacheEntry::USED;
+            ++it;
+        } else {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+        }
+    }
+    if (it != cacheCoins.end())
+        clockHand = it->first;
+    // With nothing left, the pool's chunks can be given back as in Flush()
+    if (cacheCoins.empty())
+        ReallocateCache();
+}
+
+void CCoinsViewCache::ReallocateCache()
+{
+    // Clearing the map hands its nodes back to the pool, which keeps them for
+    // reuse; only a new pool gives the memory back.
+    assert(cacheCoins.empty());
+    cacheCoins.~CCoinsMap();
+    cacheCoinsResource.~CCoinsMapMemoryResource();
+    ::new (&cacheCoinsResource) CCoinsMapMemoryResource();
+    ::new (&cacheCoins) CCoinsMap(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &cacheCoinsResource);
+    clockHand.SetNull();
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
-    if (it != cacheCoins.end() && it->second.flags == 0) {
+    if (it != cacheCoins.end() && !(it->second.flags & (CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH))) {
         cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
         cacheCoins.erase(it);
     }
@@ -220,6 +341,15 @@ unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
 
+size_t CCoinsViewCache::GetDirtyCount() const {
+    size_t nDirty = 0;
+    for (const auto& entry : cacheCoins) {
+        if (entry.second.flags & CCoinsCacheEntry::DIRTY)
+            nDirty++;
+    }
+    return nDirty;
+}
+
 CAmount CCoinsViewCache::GetValueIn(const CTransaction& tx) const
 {
     if (tx.IsCoinBase())
@@ -12,6 +12,7 @@
 #include <hash.h>
 #include <memusage.h>
 #include <serialize.h>
+#include <support/allocators/pool.h>
 #include <uint256.h>
 
 #include <assert.h>
@@ -19,6 +20,10 @@
 
 #include <unordered_map>
 
+template <typename T>
+class CCheckQueue;
+class CCoinsFetch;
+
 /**
  * A UTXO entry.
  *
@@ -113,13 +118,24 @@ struct CCoinsCacheEntry
          * flush the changes to the parent cache.  It is always safe to
          * not mark FRESH if that condition is not guaranteed.
          */
+        USED = (1 << 2), // Used since Trim last passed it over; gives it a second chance to stay (see CCoinsViewCache::Trim).
     };
 
     CCoinsCacheEntry() : flags(0) {}
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The coins cache allocates its nodes from a PoolResource: one node per entry,
+ * packed into large chunks instead of a malloc call (and malloc overhead) each.
+ * A node holds the entry plus the next pointer and the cached hash.
+ */
+typedef std::pair<const COutPoint, CCoinsCacheEntry> CCoinsMapValue;
+static const size_t COINS_MAP_NODE_BYTES = sizeof(CCoinsMapValue) + 2 * sizeof(void*);
+static const size_t COINS_MAP_NODE_ALIGN = alignof(CCoinsMapValue) > sizeof(void*) ? alignof(CCoinsMapValue) : sizeof(void*);
+typedef PoolAllocator<CCoinsMapValue, COINS_MAP_NODE_BYTES, COINS_MAP_NODE_ALIGN> CCoinsMapAllocator;
+typedef CCoinsMapAllocator::ResourceType CCoinsMapMemoryResource;
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>, CCoinsMapAllocator> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -151,6 +167,12 @@ public:
      */
     virtual bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
 
+    /** Retrieve the Coins for several outpoints at once. coins is resized to match
+     *  outpoints, and each entry is left spent when GetCoin would have returned false.
+     *  Views whose reads are thread-safe may look them up on the workers of pqueue.
+     */
+    virtual void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins, CCheckQueue<CCoinsFetch>* pqueue) const;
+
     //! Just check whether a given outpoint is unspent.
     virtual bool HaveCoin(const COutPoint &outpoint) const;
 
@@ -164,8 +186,9 @@ public:
     virtual std::vector<uint256> GetHeadBlocks() const;
 
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! The passed mapCoins can be modified, unless erase is false: then it is
+    //! only read, and left for the caller to keep as a cache of what was written.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -177,8 +200,36 @@ public:
     virtual size_t EstimateSize() const { return 0; }
 };
 
+/** A single read of a GetCoins batch, run on a CCheckQueue worker */
+class CCoinsFetch
+{
+private:
+    const CCoinsView* view;
+    const COutPoint* outpoint;
+    Coin* coin;
 
-/** CCoinsView backed by another CCoinsView */
+public:
+    CCoinsFetch() : view(nullptr), outpoint(nullptr), coin(nullptr) {}
+    CCoinsFetch(const CCoinsView* viewIn, const COutPoint* outpointIn, Coin* coinIn) : view(viewIn), outpoint(outpointIn), coin(coinIn) {}
+
+    //! Fails rather than throws on a read error, which workers can't report
+    bool operator()();
+
+    void swap(CCoinsFetch& check)
+    {
+        std::swap(view, check.view);
+        std::swap(outpoint, check.outpoint);
+        std::swap(coin, check.coin);
+    }
+};
+
+
+/** CCoinsView backed by another CCoinsView
+ *
+ *  GetCoins is not forwarded to the backing view: it is left to the per-outpoint
+ *  GetCoin loop, so subclasses that only override GetCoin still see every read.
+ *  Views that don't change what the backing view returns may forward it.
+ */
 class CCoinsViewBacked : public CCoinsView
 {
 protected:
@@ -191,7 +242,7 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -206,8 +257,12 @@ protected:
      * declared as "const".  
      */
     mutable uint256 hashBlock;
+    mutable CCoinsMapMemoryResource cacheCoinsResource;
     mutable CCoinsMap cacheCoins;
 
+    /* The entry the last Trim stopped at, which the next one carries on from. */
+    COutPoint clockHand;
+
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
@@ -221,10 +276,11 @@ public:
 
     // Standard CCoinsView methods
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins, CCheckQueue<CCoinsFetch>* pqueue) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -236,6 +292,12 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Load the given outpoints into the cache, fetching all those not yet
+     * cached from the backing view in one GetCoins batch.
+     */
+    void PrefetchCoins(const std::vector<COutPoint>& outpoints, CCheckQueue<CCoinsFetch>* pqueue) const;
+
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin.
@@ -268,6 +330,21 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base, like Flush(),
+     * but keep the unspent coins cached, now unmodified.
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync();
+
+    /**
+     * Evict unmodified coins until the cache uses at most nTargetUsage bytes,
+     * or only modified ones are left. Coins that were used since the last
+     * Trim passed them over are kept a round longer, so that coins not used
+     * lately go first.
+     */
+    void Trim(size_t nTargetUsage);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -277,6 +354,9 @@ public:
     //! Calculate the size of the cache (in number of transaction outputs)
     unsigned int GetCacheSize() const;
 
+    //! Count the cache entries the next Flush() or Sync() writes to the base
+    size_t GetDirtyCount() const;
+
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
@@ -295,6 +375,9 @@ public:
 
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
+
+    //! Replace the (empty) cache map and its memory pool with fresh ones, releasing the pool's chunks
+    void ReallocateCache();
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
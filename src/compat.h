@@ -48,6 +48,10 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#define USE_EPOLL
+#endif
+
 #ifndef WIN32
 typedef unsigned int SOCKET;
 #include <errno.h>
@@ -86,8 +90,10 @@ typedef int32_t ssize_t;
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
+// With epoll, the socket handler waits on epoll and netbase on poll(), so no
+// socket ever reaches an fd_set and FD_SETSIZE doesn't apply
 bool static inline IsSelectableSocket(const SOCKET& s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_EPOLL)
     return true;
 #else
     return (s < FD_SETSIZE);
@@ -30,6 +30,12 @@
 #undef HUGEPAGE_SIZE
 #endif
 
+/*
+ * Nonzero to back every region with huge pages and pre-fault it, regardless
+ * of HUGEPAGE_THRESHOLD.  Set through YespowerSetHugePages() before hashing.
+ */
+extern int yespower_hugepages;
+
 static void *alloc_region(yespower_region_t *region, size_t size)
 {
 	size_t base_size = size;
@@ -40,10 +46,12 @@ static void *alloc_region(yespower_region_t *region, size_t size)
 	    MAP_NOCORE |
 #endif
 	    MAP_ANON | MAP_PRIVATE;
+	aligned = NULL;
 #if defined(MAP_HUGETLB) && defined(HUGEPAGE_SIZE)
 	size_t new_size = size;
 	const size_t hugepage_mask = (size_t)HUGEPAGE_SIZE - 1;
-	if (size >= HUGEPAGE_THRESHOLD && size + hugepage_mask >= size) {
+	if ((size >= HUGEPAGE_THRESHOLD || yespower_hugepages) &&
+	    size + hugepage_mask >= size) {
 		flags |= MAP_HUGETLB;
 /*
  * Linux's munmap() fails on MAP_HUGETLB mappings if size is not a multiple of
@@ -57,6 +65,22 @@ static void *alloc_region(yespower_region_t *region, size_t size)
 		base_size = new_size;
 	} else if (flags & MAP_HUGETLB) {
 		flags &= ~MAP_HUGETLB;
+#ifdef MADV_HUGEPAGE
+/*
+ * No huge pages reserved: over-allocate so that a huge page aligned region
+ * fits, and ask for transparent huge pages there.  madvise() is only advisory,
+ * so its failure leaves us with regular pages.
+ */
+		if (yespower_hugepages &&
+		    new_size + hugepage_mask >= new_size &&
+		    (base = mmap(NULL, new_size + hugepage_mask,
+		    PROT_READ | PROT_WRITE, flags, -1, 0)) != MAP_FAILED) {
+			base_size = new_size + hugepage_mask;
+			aligned = base + hugepage_mask;
+			aligned -= (uintptr_t)aligned & hugepage_mask;
+			madvise(aligned, new_size, MADV_HUGEPAGE);
+		} else
+#endif
 		base = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
 	}
 
@@ -65,7 +89,8 @@ static void *alloc_region(yespower_region_t *region, size_t size)
 #endif
 	if (base == MAP_FAILED)
 		base = NULL;
-	aligned = base;
+	if (!base || !aligned)
+		aligned = base;
 #elif defined(HAVE_POSIX_MEMALIGN)
 	if ((errno = posix_memalign((void **)&base, 64, size)) != 0)
 		base = NULL;
@@ -79,6 +104,9 @@ static void *alloc_region(yespower_region_t *region, size_t size)
 		aligned -= (uintptr_t)aligned & 63;
 	}
 #endif
+/* Take the first-touch page faults now rather than during the first hash */
+	if (aligned && yespower_hugepages)
+		memset(aligned, 0, size);
 	region->base = base;
 	region->aligned = aligned;
 	region->base_size = base ? base_size : 0;
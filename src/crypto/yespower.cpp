@@ -0,0 +1,140 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/yespower.h>
+#include <crypto/common.h>
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+typedef int (*YespowerFn)(yespower_local_t* local, const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+typedef int (*YespowerTlsFn)(const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+
+extern "C" {
+int yespower_generic(yespower_local_t* local, const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+int yespower_tls_generic(const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+
+#if defined(ENABLE_YESPOWER_AVX) && !defined(BUILD_BITCOIN_INTERNAL)
+int yespower_avx(yespower_local_t* local, const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+int yespower_tls_avx(const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+#endif
+#if defined(ENABLE_YESPOWER_XOP) && !defined(BUILD_BITCOIN_INTERNAL)
+int yespower_xop(yespower_local_t* local, const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+int yespower_tls_xop(const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+#endif
+}
+
+namespace
+{
+YespowerFn Yespower = yespower_generic;
+YespowerTlsFn YespowerTls = yespower_tls_generic;
+
+/** Check a kernel against the yespower 1.0 vectors from yespower-1.0.1/TESTS-OK. */
+bool SelfTest(YespowerFn fn)
+{
+    static const yespower_params_t params[2] = {
+        {YESPOWER_1_0, 2048, 32, nullptr, 0},
+        {YESPOWER_1_0, 1024, 32, (const uint8_t*)"personality test", 16},
+    };
+    static const unsigned char out[2][32] = {
+        {0xd5, 0xef, 0xb8, 0x13, 0xcd, 0x26, 0x3e, 0x9b, 0x34, 0x54, 0x01, 0x30, 0x23, 0x3c, 0xbb, 0xc6,
+         0xa9, 0x21, 0xfb, 0xff, 0x34, 0x31, 0xe5, 0xec, 0x1a, 0x1a, 0xbd, 0xe2, 0xae, 0xa6, 0xff, 0x4d},
+        {0x1f, 0x02, 0x69, 0xac, 0xf5, 0x65, 0xc4, 0x9a, 0xdc, 0x0e, 0xf9, 0xb8, 0xf2, 0x6a, 0xb3, 0x80,
+         0x8c, 0xdc, 0x38, 0x39, 0x4a, 0x25, 0x4f, 0xdd, 0xee, 0xdc, 0xc3, 0xaa, 0xcf, 0xf6, 0xad, 0x9d},
+    };
+    uint8_t src[80];
+    for (size_t i = 0; i < sizeof(src); i++) src[i] = i * 3;
+
+    yespower_local_t local;
+    yespower_init_local(&local);
+    bool ret = true;
+    for (int i = 0; i < 2 && ret; i++) {
+        yespower_binary_t dst;
+        ret = fn(&local, src, sizeof(src), &params[i], &dst) == 0 && memcmp(dst.uc, out[i], sizeof(dst.uc)) == 0;
+    }
+    yespower_free_local(&local);
+    return ret;
+}
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+/** Check whether the OS saves the register state selected by mask (XCR0). */
+bool OSSavesState(uint32_t mask)
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & mask) == mask;
+}
+#endif
+
+} // namespace
+
+const yespower_params_t yespower_1_0_sugarchain = {
+    YESPOWER_1_0,
+    2048,
+    32,
+    (const uint8_t*)"Satoshi Nakamoto 31/Oct/2008 Proof-of-work is essentially one-CPU-one-vote",
+    74
+};
+
+extern "C" {
+int yespower_hugepages = 0;
+
+int yespower(yespower_local_t* local, const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst)
+{
+    return Yespower(local, src, srclen, params, dst);
+}
+
+int yespower_tls(const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst)
+{
+    return YespowerTls(src, srclen, params, dst);
+}
+}
+
+void YespowerSetHugePages(bool fEnable)
+{
+    yespower_hugepages = fEnable;
+}
+
+std::string YespowerAutoDetect()
+{
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    bool have_avx = false, have_xop = false;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && ((ecx >> 27) & 1) && ((ecx >> 28) & 1)) {
+        have_avx = OSSavesState(0x6);
+        if (have_avx && __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx)) {
+            have_xop = (ecx >> 11) & 1;
+        }
+    }
+    (void)have_xop;
+
+#if defined(ENABLE_YESPOWER_XOP) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_xop && SelfTest(yespower_xop)) {
+        Yespower = yespower_xop;
+        YespowerTls = yespower_tls_xop;
+        return "xop";
+    }
+#endif
+#if defined(ENABLE_YESPOWER_AVX) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx && SelfTest(yespower_avx)) {
+        Yespower = yespower_avx;
+        YespowerTls = yespower_tls_avx;
+        return "avx";
+    }
+#endif
+#endif
+
+    Yespower = yespower_generic;
+    YespowerTls = yespower_tls_generic;
+    assert(SelfTest(Yespower));
+#if defined(__SSE2__)
+    return "sse2";
+#else
+    return "generic";
+#endif
+}
@@ -0,0 +1,31 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_YESPOWER_H
+#define BITCOIN_CRYPTO_YESPOWER_H
+
+#include <crypto/yespower-1.0.1/yespower.h>
+
+#include <string>
+
+/** The yespower 1.0 parameters of the Sugarchain proof of work. */
+extern const yespower_params_t yespower_1_0_sugarchain;
+
+/** Autodetect the best available yespower kernel, self-test it, and make
+ *  yespower() and yespower_tls() use it.
+ *  Returns the name of the kernel.
+ */
+std::string YespowerAutoDetect();
+
+/** Back yespower scratch regions with huge pages (reserved ones if any,
+ *  transparent ones otherwise) and pre-fault them. Falls back to regular
+ *  pages silently. Only affects regions allocated afterwards, so call it
+ *  before any thread hashes.
+ */
+void YespowerSetHugePages(bool fEnable);
+
+//! Default for -powhugepages
+static const bool DEFAULT_POW_HUGEPAGES = false;
+
+#endif // BITCOIN_CRYPTO_YESPOWER_H
@@ -0,0 +1,17 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// yespower-opt.c built with -mavx. Only linked when the compiler supports
+// these flags; crypto/yespower.cpp selects it at runtime if the CPU does too.
+
+#ifdef ENABLE_YESPOWER_AVX
+
+#define yespower yespower_avx
+#define yespower_tls yespower_tls_avx
+#define yespower_init_local yespower_init_local_avx
+#define yespower_free_local yespower_free_local_avx
+
+#include "yespower-1.0.1/yespower-opt.c"
+
+#endif
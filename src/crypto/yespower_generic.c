@@ -0,0 +1,12 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// yespower-opt.c built with the baseline compiler flags (SSE2 on x86-64).
+// yespower() and yespower_tls() are provided by crypto/yespower.cpp, which
+// dispatches to this or one of the other compiled kernels at runtime.
+
+#define yespower yespower_generic
+#define yespower_tls yespower_tls_generic
+
+#include "yespower-1.0.1/yespower-opt.c"
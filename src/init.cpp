@@ -12,11 +12,14 @@
 
 #include <addrman.h>
 #include <amount.h>
+#include <base58.h>
+#include <blockfilemap.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
+#include <crypto/yespower.h>
 #include <fs.h>
 #include <httpserver.h>
 #include <httprpc.h>
@@ -141,16 +144,29 @@ public:
         try {
             return CCoinsViewBacked::GetCoin(outpoint, coin);
         } catch(const std::runtime_error& e) {
-            uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
-            LogPrintf("Error reading from database: %s\n", e.what());
-            // Starting the shutdown sequence and returning false to the caller would be
-            // interpreted as 'entry not found' (as opposed to unable to read data), and
-            // could lead to invalid interpretation. Just exit immediately, as we can't
-            // continue anyway, and all writes should be atomic.
-            abort();
+            AbortOnReadError(e);
+        }
+    }
+    // Only adds error handling, so the database's batched reads can be used as they are
+    void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins, CCheckQueue<CCoinsFetch>* pqueue) const override {
+        try {
+            base->GetCoins(outpoints, coins, pqueue);
+        } catch(const std::runtime_error& e) {
+            AbortOnReadError(e);
         }
     }
     // Writes do not need similar protection, as failure to write is handled by the caller.
+
+private:
+    [[noreturn]] static void AbortOnReadError(const std::runtime_error& e) {
+        uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
+        LogPrintf("Error reading from database: %s\n", e.what());
+        // Starting the shutdown sequence and returning false to the caller would be
+        // interpreted as 'entry not found' (as opposed to unable to read data), and
+        // could lead to invalid interpretation. Just exit immediately, as we can't
+        // continue anyway, and all writes should be atomic.
+        abort();
+    }
 };
 
 static std::unique_ptr<CCoinsViewErrorCatcher> pcoinscatcher;
@@ -189,6 +205,7 @@ void Shutdown()
     StopREST();
     StopRPC();
     StopHTTPServer();
+    GenerateSugarchain(false, 0, CScript(), Params());
 #ifdef ENABLE_WALLET
     FlushWallets();
 #endif
@@ -248,6 +265,7 @@ void Shutdown()
         pcoinscatcher.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
+        ppowhashdb.reset();
     }
 #ifdef ENABLE_WALLET
     StopWallets();
@@ -341,6 +359,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("Print this help message and exit"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-backgroundflush", strprintf(_("Write the coins cache to disk from a background thread instead of stalling block validation (default: %u)"), DEFAULT_BACKGROUND_FLUSH));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
@@ -367,10 +386,13 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug) {
         strUsage += HelpMessageOpt("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()));
     }
+    strUsage += HelpMessageOpt("-mmapblockfiles=<n>", strprintf(_("Keep up to <n> block and undo files memory-mapped for reading blocks (0 to disable, default: %d)"), DEFAULT_MMAP_BLOCK_FILES));
+    strUsage += HelpMessageOpt("-powcache", strprintf(_("Keep an on-disk cache of block PoW hashes to avoid recomputing yespower on reindex and block verification (default: %u)"), DEFAULT_POWCACHE));
+    strUsage += HelpMessageOpt("-powhugepages", strprintf(_("Back yespower scratch memory with huge pages where available and pre-fault it (default: %u)"), DEFAULT_POW_HUGEPAGES));
     strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
-    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
-        -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d). As many threads, but at most %d, %d and %d, verify header PoW, read coins and read blocks ahead"),
+        -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS, MAX_POWCHECK_THREADS, MAX_COINS_FETCH_THREADS, MAX_BLOCK_PREFETCH_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
@@ -401,6 +423,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
     strUsage += HelpMessageOpt("-maxtimeadjustment", strprintf(_("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)"), DEFAULT_MAX_TIME_ADJUSTMENT));
+    strUsage += HelpMessageOpt("-msghandthreads=<n>", strprintf(_("Number of threads to process peer messages on, peers are divided between them (1 to %d, default: %d)"), MAX_MSGHAND_THREADS, DEFAULT_MSGHAND_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
@@ -500,6 +523,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-whitelistforcerelay", strprintf(_("Force relay of transactions from whitelisted peers even if they violate local relay policy (default: %d)"), DEFAULT_WHITELISTFORCERELAY));
 
     strUsage += HelpMessageGroup(_("Block creation options:"));
+    strUsage += HelpMessageOpt("-gen", strprintf(_("Generate coins with the internal miner (default: %u)"), DEFAULT_GENERATE));
+    strUsage += HelpMessageOpt("-genaddress=<address>", _("Address the internal miner pays its blocks to (required with -gen)"));
+    strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Set the number of internal miner threads (-1 = all cores, default: %d)"), DEFAULT_GENERATE_THREADS));
     strUsage += HelpMessageOpt("-blockmaxweight=<n>", strprintf(_("Set maximum BIP141 block weight (default: %d)"), DEFAULT_BLOCK_MAX_WEIGHT));
     strUsage += HelpMessageOpt("-blockmintxfee=<amt>", strprintf(_("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)"), CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)));
     if (showDebug)
@@ -937,12 +963,15 @@ bool AppInitParameterInteraction()
     }
 
     // Make sure enough file descriptors are available
-    int nBind = std::max(nUserBind, size_t(1));
     nUserMaxConnections = gArgs.GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
     // Trim requested connection counts, to fit into system limitations
+#ifndef USE_EPOLL
+    // select() can't wait on sockets numbered FD_SETSIZE or higher
+    int nBind = std::max(nUserBind, size_t(1));
     nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
+#endif
     nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + MAX_ADDNODE_CONNECTIONS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -1050,6 +1079,11 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    int nMmapBlockFiles = gArgs.GetArg("-mmapblockfiles", DEFAULT_MMAP_BLOCK_FILES);
+    if (nMmapBlockFiles < 0)
+        return InitError(_("-mmapblockfiles cannot be configured with a negative value."));
+    blockFileMap.SetMaxFiles(nMmapBlockFiles);
+
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = gArgs.GetArg("-prune", 0);
     if (nPruneArg < 0) {
@@ -1194,6 +1228,9 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string yespower_algo = YespowerAutoDetect();
+    LogPrintf("Using the '%s' yespower implementation\n", yespower_algo);
+    YespowerSetHugePages(gArgs.GetBoolArg("-powhugepages", DEFAULT_POW_HUGEPAGES));
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1258,10 +1295,17 @@ bool AppInitMain()
     InitSignatureCache();
     InitScriptExecutionCache();
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script verification, %u for header PoW, %u for coin reads and %u for block read-ahead\n", nScriptCheckThreads,
+        std::min(nScriptCheckThreads, MAX_POWCHECK_THREADS), std::min(nScriptCheckThreads, MAX_COINS_FETCH_THREADS), std::min(nScriptCheckThreads, MAX_BLOCK_PREFETCH_THREADS));
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<std::min(nScriptCheckThreads, MAX_POWCHECK_THREADS)-1; i++)
+            threadGroup.create_thread(&ThreadPoWCheck);
+        for (int i=0; i<std::min(nScriptCheckThreads, MAX_COINS_FETCH_THREADS)-1; i++)
+            threadGroup.create_thread(&ThreadCoinsFetch);
+        for (int i=0; i<std::min(nScriptCheckThreads, MAX_BLOCK_PREFETCH_THREADS)-1; i++)
+            threadGroup.create_thread(&ThreadBlockPrefetch);
     }
 
     // Start the lightweight task scheduler thread
@@ -1423,6 +1467,11 @@ bool AppInitMain()
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     nBlockTreeDBCache = std::min(nBlockTreeDBCache, (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nPoWHashCache = 0;
+    if (gArgs.GetBoolArg("-powcache", DEFAULT_POWCACHE)) {
+        nPoWHashCache = std::min(nTotalCache / 8, nPoWHashDBCache << 20);
+        nTotalCache -= nPoWHashCache;
+    }
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1431,6 +1480,8 @@ bool AppInitMain()
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
+    if (nPoWHashCache)
+        LogPrintf("* Using %.1fMiB for PoW hash cache database\n", nPoWHashCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
@@ -1451,6 +1502,10 @@ bool AppInitMain()
                 // fails if it's still open from the previous loop. Close it first:
                 pblocktree.reset();
                 pblocktree.reset(new CBlockTreeDB(nBlockTreeDBCache, false, fReset));
+                // PoW hashes depend only on the header, so the cache survives -reindex.
+                ppowhashdb.reset();
+                if (nPoWHashCache)
+                    ppowhashdb.reset(new CPoWHashDB(nPoWHashCache));
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
@@ -1501,7 +1556,7 @@ bool AppInitMain()
                 // At this point we're either in reindex or we've loaded a useful
                 // block tree into mapBlockIndex!
 
-                pcoinsdbview.reset(new CCoinsViewDB(nCoinDBCache, false, fReset || fReindexChainState));
+                pcoinsdbview.reset(new CCoinsViewDB(nCoinDBCache, false, fReset || fReindexChainState, gArgs.GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH)));
                 pcoinscatcher.reset(new CCoinsViewErrorCatcher(pcoinsdbview.get()));
 
                 // If necessary, upgrade from older database format.
@@ -1709,6 +1764,7 @@ bool AppInitMain()
     connOptions.nMaxOutbound = std::min(MAX_OUTBOUND_CONNECTIONS, connOptions.nMaxConnections);
     connOptions.nMaxAddnode = MAX_ADDNODE_CONNECTIONS;
     connOptions.nMaxFeeler = 1;
+    connOptions.nMsgHandThreads = gArgs.GetArg("-msghandthreads", DEFAULT_MSGHAND_THREADS);
     connOptions.nBestHeight = chain_active_height;
     connOptions.uiInterface = &uiInterface;
     connOptions.m_msgproc = peerLogic.get();
@@ -1759,7 +1815,17 @@ bool AppInitMain()
         return false;
     }
 
-    // ********************************************************* Step 12: finished
+    // ********************************************************* Step 12: start the internal miner
+
+    if (gArgs.GetBoolArg("-gen", DEFAULT_GENERATE)) {
+        CTxDestination dest = DecodeDestination(gArgs.GetArg("-genaddress", ""));
+        if (!IsValidDestination(dest)) {
+            return InitError(strprintf(_("-gen requires a valid -genaddress: '%s'"), gArgs.GetArg("-genaddress", "")));
+        }
+        GenerateSugarchain(true, gArgs.GetArg("-genproclimit", DEFAULT_GENERATE_THREADS), GetScriptForDestination(dest), chainparams);
+    }
+
+    // ********************************************************* Step 13: finished
 
     SetRPCWarmupFinished();
     uiInterface.InitMessage(_("Done loading"));
@@ -6,6 +6,7 @@
 #define BITCOIN_MEMUSAGE_H
 
 #include <indirectmap.h>
+#include <support/allocators/pool.h>
 
 #include <stdlib.h>
 
@@ -165,6 +166,22 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template<typename X, typename Y, typename Z, typename E, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z, E, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> >& m)
+{
+    // The nodes live in the pool's chunks, and so does the bucket array while
+    // it is small enough. Count the chunks, less what the pool holds ready for
+    // reuse: that is taken before any new chunk, so the pool only grows once
+    // the memory in use does.
+    const auto* resource = m.get_allocator().Resource();
+    size_t nBucketBytes = sizeof(void*) * m.bucket_count();
+    size_t nUsage = MallocUsage(resource->ChunkSizeBytes()) * resource->NumAllocatedChunks() +
+                    MallocUsage(sizeof(void*) * resource->NumAllocatedChunks()) - resource->UnusedBytes();
+    if (nBucketBytes > MAX_BLOCK_SIZE_BYTES)
+        nUsage += MallocUsage(nBucketBytes);
+    return nUsage;
+}
+
 }
 
 #endif // BITCOIN_MEMUSAGE_H
@@ -13,6 +13,8 @@
 #include <consensus/tx_verify.h>
 #include <consensus/merkle.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
+#include <crypto/yespower.h>
 #include <hash.h>
 #include <validation.h>
 #include <net.h>
@@ -21,14 +23,18 @@
 #include <pow.h>
 #include <primitives/transaction.h>
 #include <script/standard.h>
+#include <streams.h>
 #include <timedata.h>
 #include <util.h>
 #include <utilmoneystr.h>
 #include <validationinterface.h>
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <queue>
+#include <thread>
 #include <utility>
 
 //////////////////////////////////////////////////////////////////////////////
@@ -456,3 +462,175 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Internal miner
+//
+
+namespace {
+
+/** Counts tip changes so that the mining threads drop stale work right away. */
+class CMinerTipNotifier final : public CValidationInterface
+{
+public:
+    std::atomic<uint64_t> nTipUpdates{0};
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override
+    {
+        ++nTipUpdates;
+    }
+};
+
+/** A block template shared by all mining threads, with its header serialized once. */
+struct CMinerJob
+{
+    CBlock block;
+    unsigned char header[80];
+    uint64_t nId;
+    //! Value of nTipUpdates before the template was built
+    uint64_t nTipUpdates;
+    int64_t nCreated;
+};
+
+//! Rebuild templates after this many seconds to pick up new transactions and a fresh nTime
+static const int64_t MINER_JOB_MAX_AGE = 60;
+
+// Static so that a tip notification still queued when the miner stops has something to call.
+CMinerTipNotifier g_miner_notifier;
+std::atomic<bool> g_miner_stop{false};
+std::atomic<uint64_t> g_miner_job_id{0};
+
+std::mutex g_miner_job_mutex;
+std::shared_ptr<const CMinerJob> g_miner_job;
+unsigned int g_miner_extra_nonce = 0;
+
+std::mutex g_miner_threads_mutex;
+std::vector<std::thread> g_miner_threads;
+
+bool IsStale(const CMinerJob& job)
+{
+    return job.nId != g_miner_job_id || job.nTipUpdates != g_miner_notifier.nTipUpdates || GetTime() - job.nCreated >= MINER_JOB_MAX_AGE;
+}
+
+/**
+ * Return the current job, building a new one if it is stale or is the job
+ * nExhaustedId the caller has finished with. Building a job bumps
+ * g_miner_job_id, which makes every other thread drop the old one.
+ * Returns nullptr while in initial block download, when getblocktemplate
+ * refuses to hand out work too.
+ */
+std::shared_ptr<const CMinerJob> GetMinerJob(const CChainParams& chainparams, const CScript& scriptPubKey, uint64_t nExhaustedId)
+{
+    if (IsInitialBlockDownload())
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(g_miner_job_mutex);
+    if (g_miner_job && g_miner_job->nId != nExhaustedId && !IsStale(*g_miner_job))
+        return g_miner_job;
+
+    std::shared_ptr<CMinerJob> job = std::make_shared<CMinerJob>();
+    job->nTipUpdates = g_miner_notifier.nTipUpdates;
+    try {
+        std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(chainparams).CreateNewBlock(scriptPubKey));
+        if (!pblocktemplate)
+            return nullptr;
+        job->block = pblocktemplate->block;
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        return nullptr;
+    }
+    {
+        LOCK(cs_main);
+        // The tip may have moved since CreateNewBlock; take the height from the template's parent.
+        BlockMap::const_iterator it = mapBlockIndex.find(job->block.hashPrevBlock);
+        if (it == mapBlockIndex.end())
+            return nullptr;
+        IncrementExtraNonce(&job->block, it->second, g_miner_extra_nonce);
+    }
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << static_cast<const CBlockHeader&>(job->block);
+    assert(ss.size() == sizeof(job->header));
+    memcpy(job->header, ss.data(), sizeof(job->header));
+    job->nId = ++g_miner_job_id;
+    job->nCreated = GetTime();
+    g_miner_job = job;
+    return g_miner_job;
+}
+
+/**
+ * Grind nonces [nThread, nThread + 1) * 2^32 / nThreads of the current job
+ * with this thread's own scratch region, patching the nonce into the
+ * serialized header in place.
+ */
+void SugarchainMiner(int nThread, int nThreads, const CChainParams& chainparams, const CScript& scriptPubKey)
+{
+    const uint64_t nNonceBegin = (uint64_t{1} << 32) * nThread / nThreads;
+    const uint64_t nNonceEnd = (uint64_t{1} << 32) * (nThread + 1) / nThreads;
+    yespower_local_t local;
+    yespower_init_local(&local);
+
+    uint64_t nExhaustedId = 0;
+    while (!g_miner_stop) {
+        std::shared_ptr<const CMinerJob> job = GetMinerJob(chainparams, scriptPubKey, nExhaustedId);
+        if (!job) {
+            for (int i = 0; i < 10 && !g_miner_stop; i++)
+                MilliSleep(100);
+            continue;
+        }
+
+        unsigned char header[sizeof(job->header)];
+        memcpy(header, job->header, sizeof(header));
+        for (uint64_t nNonce = nNonceBegin; nNonce < nNonceEnd && !g_miner_stop && !IsStale(*job); nNonce++) {
+            WriteLE32(header + 76, nNonce);
+            uint256 hash;
+            if (yespower(&local, header, sizeof(header), &yespower_1_0_sugarchain, (yespower_binary_t*)&hash)) {
+                LogPrintf("%s: failed to compute PoW hash (out of memory?)\n", __func__);
+                g_miner_stop = true;
+                break;
+            }
+            if (CheckProofOfWork(hash, job->block.nBits, chainparams.GetConsensus())) {
+                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(job->block);
+                pblock->nNonce = nNonce;
+                LogPrintf("SugarchainMiner: proof-of-work found\n  hash: %s\n  pow: %s\n", pblock->GetHash().GetHex(), hash.GetHex());
+                if (!ProcessNewBlock(chainparams, pblock, true, nullptr))
+                    LogPrintf("SugarchainMiner: block not accepted\n");
+                break;
+            }
+        }
+        // Found, exhausted or stale: either way the next job must be a different one.
+        nExhaustedId = job->nId;
+    }
+
+    yespower_free_local(&local);
+}
+
+} // namespace
+
+void GenerateSugarchain(bool fGenerate, int nThreads, const CScript& scriptPubKey, const CChainParams& chainparams)
+{
+    std::lock_guard<std::mutex> lock(g_miner_threads_mutex);
+    if (!g_miner_threads.empty()) {
+        g_miner_stop = true;
+        for (std::thread& thread : g_miner_threads)
+            thread.join();
+        g_miner_threads.clear();
+        UnregisterValidationInterface(&g_miner_notifier);
+        std::lock_guard<std::mutex> lock_job(g_miner_job_mutex);
+        g_miner_job.reset();
+    }
+
+    if (nThreads < 0)
+        nThreads = GetNumCores();
+    if (!fGenerate || nThreads == 0)
+        return;
+
+    g_miner_stop = false;
+    RegisterValidationInterface(&g_miner_notifier);
+    for (int i = 0; i < nThreads; i++) {
+        g_miner_threads.emplace_back(&TraceThread<std::function<void()>>, "miner",
+            std::function<void()>(std::bind(&SugarchainMiner, i, nThreads, std::cref(chainparams), scriptPubKey)));
+    }
+}
@@ -21,6 +21,8 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+static const bool DEFAULT_GENERATE = false;
+static const int DEFAULT_GENERATE_THREADS = 1;
 
 struct CBlockTemplate
 {
@@ -196,4 +198,12 @@ private:
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
+/**
+ * Run the internal miner: nThreads worker threads (<0 = one per core) share a
+ * block template paying to scriptPubKey and grind disjoint nonce ranges of it.
+ * Stops any running miner first, so fGenerate == false (or nThreads == 0)
+ * just stops it.
+ */
+void GenerateSugarchain(bool fGenerate, int nThreads, const CScript& scriptPubKey, const CChainParams& chainparams);
+
 #endif // BITCOIN_MINER_H
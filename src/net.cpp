@@ -25,6 +25,11 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
 #endif
 
 #ifdef USE_UPNP
@@ -43,6 +48,28 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// How long the socket handler waits for events before polling pnode->vSend again.
+static const int SELECT_TIMEOUT_MILLISECONDS = 50;
+// How often the socket handler checks all peers for inactivity.
+static const int64_t INACTIVITY_CHECK_INTERVAL = 1;
+
+#ifdef USE_EPOLL
+// Events taken from the kernel per epoll_wait() call; the rest wait for the next one.
+static const int MAX_EPOLL_EVENTS = 1024;
+#endif
+
+// Size of the socket handler's receive buffer; typical socket buffers are 8K-64K.
+static const unsigned int RECV_BUFFER_SIZE = 0x10000;
+// Payload remainders at least this large are received straight into the message.
+static const unsigned int MIN_DIRECT_RECV_SIZE = RECV_BUFFER_SIZE;
+// Limit on one direct receive, matching how far ahead readData() allocates.
+static const unsigned int MAX_DIRECT_RECV_SIZE = 256 * 1024;
+
+#ifndef WIN32
+// Queued send buffers handed to the kernel per sendmsg() call.
+static const size_t MAX_SEND_IOVECS = 64;
+#endif
+
 #if !defined(HAVE_MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -456,6 +483,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
     CAddress addr_bind = GetBindAddress(hSocket);
     CNode* pnode = new CNode(id, nLocalServices, GetBestHeight(), hSocket, addrConnect, CalculateKeyedNetGroup(addrConnect), nonce, addr_bind, pszDest ? pszDest : "", false);
     pnode->AddRef();
+    UpdateSocketEvents(pnode);
 
     return pnode;
 }
@@ -487,6 +515,13 @@ void CNode::CloseSocketDisconnect()
     if (hSocket != INVALID_SOCKET)
     {
         LogPrint(BCLog::NET, "disconnecting peer=%d\n", id);
+#ifdef USE_EPOLL
+        // Leave the epoll set while the number still names this socket
+        if (epollfd != -1) {
+            epoll_ctl(epollfd, EPOLL_CTL_DEL, hSocket, nullptr);
+            epollfd = -1;
+        }
+#endif
         CloseSocket(hSocket);
     }
 }
@@ -770,16 +805,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         nBytes -= handled;
 
         if (msg.complete()) {
-
-            //store received bytes per message command
-            //to prevent a memory DOS, only allow valid commands
-            mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand);
-            if (i == mapRecvBytesPerMsgCmd.end())
-                i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
-            assert(i != mapRecvBytesPerMsgCmd.end());
-            i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
-
-            msg.nTime = nTimeMicros;
+            MessageReceived(msg, nTimeMicros);
             complete = true;
         }
     }
@@ -787,6 +813,50 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+char* CNode::GetRecvPayloadBuffer(unsigned int& nBytes)
+{
+    LOCK(cs_vRecv);
+    if (vRecvMsg.empty() || !vRecvMsg.back().in_data || vRecvMsg.back().complete())
+        return nullptr;
+    CNetMessage& msg = vRecvMsg.back();
+    if (msg.hdr.nMessageSize > MAX_PROTOCOL_MESSAGE_LENGTH)
+        return nullptr;
+    // Smaller remainders are cheaper to pick up along with the next header.
+    nBytes = msg.hdr.nMessageSize - msg.nDataPos;
+    if (nBytes < MIN_DIRECT_RECV_SIZE)
+        return nullptr;
+    nBytes = std::min(nBytes, MAX_DIRECT_RECV_SIZE);
+    return msg.GetDataBuffer(nBytes);
+}
+
+void CNode::ReceivedPayloadBytes(unsigned int nBytes, bool& complete)
+{
+    complete = false;
+    int64_t nTimeMicros = GetTimeMicros();
+    LOCK(cs_vRecv);
+    nLastRecv = nTimeMicros / 1000000;
+    nRecvBytes += nBytes;
+    CNetMessage& msg = vRecvMsg.back();
+    msg.DataReceived(nBytes);
+    if (msg.complete()) {
+        MessageReceived(msg, nTimeMicros);
+        complete = true;
+    }
+}
+
+void CNode::MessageReceived(CNetMessage& msg, int64_t nTimeMicros)
+{
+    //store received bytes per message command
+    //to prevent a memory DOS, only allow valid commands
+    mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand);
+    if (i == mapRecvBytesPerMsgCmd.end())
+        i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(i != mapRecvBytesPerMsgCmd.end());
+    i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+
+    msg.nTime = nTimeMicros;
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -816,25 +886,27 @@ int CNode::GetSendVersion() const
 
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
-    // copy data to temporary parsing buffer
-    unsigned int nRemaining = 24 - nHdrPos;
+    unsigned int nRemaining = CMessageHeader::HEADER_SIZE - nHdrPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    memcpy(&hdrbuf[nHdrPos], pch, nCopy);
-    nHdrPos += nCopy;
-
-    // if header incomplete, exit
-    if (nHdrPos < 24)
-        return nCopy;
+    // Parse straight from the network buffer when the whole header is there,
+    // otherwise collect it in hdrbuf first.
+    const char* pchHdr = pch;
+    if (nHdrPos > 0 || nCopy < CMessageHeader::HEADER_SIZE) {
+        memcpy(&hdrbuf[nHdrPos], pch, nCopy);
+        nHdrPos += nCopy;
 
-    // deserialize to CMessageHeader
-    try {
-        hdrbuf >> hdr;
-    }
-    catch (const std::exception&) {
-        return -1;
+        // if header incomplete, exit
+        if (nHdrPos < CMessageHeader::HEADER_SIZE)
+            return nCopy;
+        pchHdr = hdrbuf;
     }
 
+    memcpy(hdr.pchMessageStart, pchHdr, CMessageHeader::MESSAGE_START_SIZE);
+    memcpy(hdr.pchCommand, pchHdr + CMessageHeader::MESSAGE_START_SIZE, CMessageHeader::COMMAND_SIZE);
+    hdr.nMessageSize = ReadLE32((const unsigned char*)pchHdr + CMessageHeader::MESSAGE_SIZE_OFFSET);
+    memcpy(hdr.pchChecksum, pchHdr + CMessageHeader::CHECKSUM_OFFSET, CMessageHeader::CHECKSUM_SIZE);
+
     // reject messages larger than MAX_SIZE
     if (hdr.nMessageSize > MAX_SIZE)
         return -1;
@@ -845,19 +917,29 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     return nCopy;
 }
 
-int CNetMessage::readData(const char *pch, unsigned int nBytes)
+char* CNetMessage::GetDataBuffer(unsigned int& nBytes)
 {
-    unsigned int nRemaining = hdr.nMessageSize - nDataPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
-
-    if (vRecv.size() < nDataPos + nCopy) {
+    nBytes = std::min(nBytes, hdr.nMessageSize - nDataPos);
+    if (vRecv.size() < nDataPos + nBytes) {
         // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nBytes + 256 * 1024));
     }
+    return &vRecv[nDataPos];
+}
 
-    hasher.Write((const unsigned char*)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
-    nDataPos += nCopy;
+void CNetMessage::DataReceived(unsigned int nBytes)
+{
+    assert(nDataPos + nBytes <= vRecv.size());
+    hasher.Write((const unsigned char*)&vRecv[nDataPos], nBytes);
+    nDataPos += nBytes;
+}
+
+int CNetMessage::readData(const char *pch, unsigned int nBytes)
+{
+    unsigned int nCopy = nBytes;
+    char* pchData = GetDataBuffer(nCopy);
+    memcpy(pchData, pch, nCopy);
+    DataReceived(nCopy);
 
     return nCopy;
 }
@@ -892,20 +974,40 @@ size_t CConnman::SocketSendData(CNode *pnode) const
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
+#ifdef WIN32
             nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Hand the kernel as many queued messages (and their separate
+            // headers) as possible in one call.
+            struct iovec iov[MAX_SEND_IOVECS];
+            size_t nIov = 0;
+            for (auto itIov = it; itIov != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++itIov, ++nIov) {
+                size_t nOffset = nIov == 0 ? pnode->nSendOffset : 0;
+                iov[nIov].iov_base = const_cast<unsigned char*>(itIov->data()) + nOffset;
+                iov[nIov].iov_len = itIov->size() - nOffset;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Retire every buffer the write covered.
+            size_t nRemaining = nBytes;
+            while (nRemaining > 0 && nRemaining >= it->size() - pnode->nSendOffset) {
+                nRemaining -= it->size() - pnode->nSendOffset;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= it->size();
                 pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
                 it++;
-            } else {
+            }
+            if (nRemaining > 0) {
                 // could not send full message; stop sending more
+                pnode->nSendOffset += nRemaining;
                 break;
             }
         } else {
@@ -1140,6 +1242,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     pnode->AddRef();
     pnode->fWhitelisted = whitelisted;
     m_msgproc->InitializeNode(pnode);
+    UpdateSocketEvents(pnode);
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
@@ -1149,9 +1252,218 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+bool CConnman::GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        recv_set.insert(hListenSocket.socket);
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+        {
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer, select() for
+            //   receiving data.
+            // * Hand off all complete messages to the processor, to be handled without
+            //   blocking here.
+
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            error_set.insert(pnode->hSocket);
+            if (select_send) {
+                send_set.insert(pnode->hSocket);
+                continue;
+            }
+            if (select_recv) {
+                recv_set.insert(pnode->hSocket);
+            }
+        }
+    }
+
+    return !recv_set.empty() || !send_set.empty() || !error_set.empty();
+}
+
+#ifdef USE_EPOLL
+void CConnman::SocketEventsEpoll(std::vector<const ListenSocket*>& vListenReady, std::vector<NodeSocketEvents>& vNodeEvents)
+{
+    // Sockets are registered when they are created and leave the set before
+    // they are closed; UpdateSocketEvents() keeps their interest current.
+    // Each registration carries its CNode, or its ListenSocket, so only the
+    // sockets that are ready are looked at. A node is only deleted by this
+    // thread once its socket has left the set, so the pointers are live.
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(epollfd, events, MAX_EPOLL_EVENTS, SELECT_TIMEOUT_MILLISECONDS);
+    if (nEvents < 0) {
+        if (errno != EINTR)
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(errno));
+        interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        const ListenSocket* pListen = nullptr;
+        for (const ListenSocket& hListenSocket : vhListenSocket) {
+            if (events[i].data.ptr == &hListenSocket) {
+                pListen = &hListenSocket;
+                break;
+            }
+        }
+        if (pListen) {
+            vListenReady.push_back(pListen);
+            continue;
+        }
+        vNodeEvents.push_back({static_cast<CNode*>(events[i].data.ptr),
+            (events[i].events & EPOLLIN) != 0,
+            (events[i].events & EPOLLOUT) != 0,
+            (events[i].events & (EPOLLERR | EPOLLHUP)) != 0});
+    }
+
+    LOCK(cs_vNodes);
+    for (const NodeSocketEvents& nodeEvents : vNodeEvents)
+        nodeEvents.pnode->AddRef();
+}
+#endif
+
+void CConnman::SocketEvents(std::vector<const ListenSocket*>& vListenReady, std::vector<NodeSocketEvents>& vNodeEvents)
+{
+#ifdef USE_EPOLL
+    SocketEventsEpoll(vListenReady, vNodeEvents);
+#else
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set)) {
+        interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        return;
+    }
+
+    //
+    // Find which sockets have data to receive
+    //
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = SELECT_TIMEOUT_MILLISECONDS * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+
+    for (SOCKET hSocket : recv_select_set) {
+        FD_SET(hSocket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+
+    for (SOCKET hSocket : send_select_set) {
+        FD_SET(hSocket, &fdsetSend);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+
+    for (SOCKET hSocket : error_select_set) {
+        FD_SET(hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+
+    int nSelect = select(hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        int nErr = WSAGetLastError();
+        LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+        for (unsigned int i = 0; i <= hSocketMax; i++)
+            FD_SET(i, &fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS)))
+            return;
+    }
+
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            vListenReady.push_back(&hListenSocket);
+        }
+    }
+
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodes) {
+        NodeSocketEvents nodeEvents = {pnode, false, false, false};
+        {
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            nodeEvents.fRecv = recv_select_set.count(pnode->hSocket) > 0 && FD_ISSET(pnode->hSocket, &fdsetRecv);
+            nodeEvents.fSend = send_select_set.count(pnode->hSocket) > 0 && FD_ISSET(pnode->hSocket, &fdsetSend);
+            nodeEvents.fError = error_select_set.count(pnode->hSocket) > 0 && FD_ISSET(pnode->hSocket, &fdsetError);
+        }
+        if (nodeEvents.fRecv || nodeEvents.fSend || nodeEvents.fError) {
+            pnode->AddRef();
+            vNodeEvents.push_back(nodeEvents);
+        }
+    }
+#endif
+}
+
+void CConnman::UpdateSocketEvents(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    if (epollfd == -1)
+        return;
+    LOCK2(pnode->cs_vSend, pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET)
+        return;
+
+    // Same interest as GenerateSelectSet(): drain the send queue before
+    // receiving more, and don't receive while the process queue is full.
+    uint32_t nEvents = 0;
+    if (!pnode->vSendMsg.empty())
+        nEvents = EPOLLOUT;
+    else if (!pnode->fPauseRecv)
+        nEvents = EPOLLIN;
+    if (pnode->epollfd != -1 && pnode->nEpollEvents == nEvents)
+        return;
+
+    struct epoll_event event = {};
+    event.events = nEvents;
+    event.data.ptr = pnode;
+    if (pnode->epollfd == -1) {
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+            LogPrintf("socket epoll add error %s\n", NetworkErrorString(errno));
+            pnode->CloseSocketDisconnect();
+            return;
+        }
+        pnode->epollfd = epollfd;
+    } else if (epoll_ctl(epollfd, EPOLL_CTL_MOD, pnode->hSocket, &event) != 0) {
+        LogPrintf("socket epoll modify error %s\n", NetworkErrorString(errno));
+        pnode->CloseSocketDisconnect();
+        return;
+    }
+    pnode->nEpollEvents = nEvents;
+#endif
+}
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    int64_t nLastInactivityCheck = 0;
     while (!interruptNet)
     {
         //
@@ -1218,140 +1530,66 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+        std::vector<const ListenSocket*> vListenReady;
+        std::vector<NodeSocketEvents> vNodeEvents;
+        SocketEvents(vListenReady, vNodeEvents);
 
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
+        if (interruptNet) {
             LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        if (interruptNet)
+            for (const NodeSocketEvents& nodeEvents : vNodeEvents)
+                nodeEvents.pnode->Release();
             return;
-
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
         }
 
         //
         // Accept new connections
         //
-        for (const ListenSocket& hListenSocket : vhListenSocket)
+        for (const ListenSocket* pListenSocket : vListenReady)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
-            {
-                AcceptConnection(hListenSocket);
-            }
+            AcceptConnection(*pListenSocket);
         }
 
         //
-        // Service each socket
+        // Service each ready socket
         //
-        std::vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy)
-                pnode->AddRef();
-        }
-        for (CNode* pnode : vNodesCopy)
+        for (const NodeSocketEvents& nodeEvents : vNodeEvents)
         {
             if (interruptNet)
-                return;
+                break;
 
-            //
-            // Receive
-            //
-            bool recvSet = false;
-            bool sendSet = false;
-            bool errorSet = false;
+            CNode* pnode = nodeEvents.pnode;
             {
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
             }
-            if (recvSet || errorSet)
+
+            //
+            // Receive
+            //
+            if (nodeEvents.fRecv || nodeEvents.fError)
             {
-                // typical socket buffer is 8K-64K
-                char pchBuf[0x10000];
+                char pchBuf[RECV_BUFFER_SIZE];
+                // Receive the bulk of large payloads (blocks) directly into
+                // the message instead of copying them out of pchBuf.
+                unsigned int nDirectSize = 0;
+                char* pchDirect = pnode->GetRecvPayloadBuffer(nDirectSize);
                 int nBytes = 0;
                 {
                     LOCK(pnode->cs_hSocket);
                     if (pnode->hSocket == INVALID_SOCKET)
                         continue;
-                    nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                    if (pchDirect)
+                        nBytes = recv(pnode->hSocket, pchDirect, nDirectSize, MSG_DONTWAIT);
+                    else
+                        nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
                 }
                 if (nBytes > 0)
                 {
                     bool notify = false;
-                    if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+                    if (pchDirect)
+                        pnode->ReceivedPayloadBytes(nBytes, notify);
+                    else if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
                         pnode->CloseSocketDisconnect();
                     RecordBytesRecv(nBytes);
                     if (notify) {
@@ -1368,7 +1606,8 @@ void CConnman::ThreadSocketHandler()
                             pnode->nProcessQueueSize += nSizeAdded;
                             pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                         }
-                        WakeMessageHandler();
+                        UpdateSocketEvents(pnode);
+                        WakeMessageHandler(pnode);
                     }
                 }
                 else if (nBytes == 0)
@@ -1395,63 +1634,87 @@ void CConnman::ThreadSocketHandler()
             //
             // Send
             //
-            if (sendSet)
+            if (nodeEvents.fSend)
             {
                 LOCK(pnode->cs_vSend);
                 size_t nBytes = SocketSendData(pnode);
                 if (nBytes) {
                     RecordBytesSent(nBytes);
                 }
-            }
-
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetSystemTimeInSeconds();
-            if (nTime - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint(BCLog::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->GetId());
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
-                {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
-                {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
-                else if (!pnode->fSuccessfullyConnected)
-                {
-                    LogPrintf("version handshake timeout from %d\n", pnode->GetId());
-                    pnode->fDisconnect = true;
-                }
+                UpdateSocketEvents(pnode);
             }
         }
         {
             LOCK(cs_vNodes);
-            for (CNode* pnode : vNodesCopy)
-                pnode->Release();
+            for (const NodeSocketEvents& nodeEvents : vNodeEvents)
+                nodeEvents.pnode->Release();
+        }
+        if (interruptNet)
+            return;
+
+        //
+        // Inactivity checking
+        //
+        int64_t nTime = GetSystemTimeInSeconds();
+        if (nTime - nLastInactivityCheck >= INACTIVITY_CHECK_INTERVAL) {
+            nLastInactivityCheck = nTime;
+            LOCK(cs_vNodes);
+            for (CNode* pnode : vNodes)
+                InactivityCheck(pnode);
         }
     }
 }
 
-void CConnman::WakeMessageHandler()
+void CConnman::InactivityCheck(CNode* pnode)
 {
+    int64_t nTime = GetSystemTimeInSeconds();
+    if (nTime - pnode->nTimeConnected > 60)
     {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint(BCLog::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->GetId());
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
+        {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        }
+        else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+        else if (!pnode->fSuccessfullyConnected)
+        {
+            LogPrintf("version handshake timeout from %d\n", pnode->GetId());
+            pnode->fDisconnect = true;
+        }
     }
-    condMsgProc.notify_one();
+}
+
+void CConnman::WakeMessageHandler()
+{
+    std::lock_guard<std::mutex> lock(mutexMsgProc);
+    for (const auto& wake : vMsgProcWake) {
+        wake->fWake = true;
+        wake->cond.notify_one();
+    }
+}
+
+void CConnman::WakeMessageHandler(const CNode* pnode)
+{
+    std::lock_guard<std::mutex> lock(mutexMsgProc);
+    size_t nShard = MessageHandlerShard(pnode);
+    if (nShard >= vMsgProcWake.size())
+        return;
+    vMsgProcWake[nShard]->fWake = true;
+    vMsgProcWake[nShard]->cond.notify_one();
 }
 
 
@@ -1993,16 +2256,25 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     }
 }
 
-void CConnman::ThreadMessageHandler()
+int CConnman::MessageHandlerShard(const CNode* pnode) const
+{
+    return pnode->GetId() % nMsgHandThreads;
+}
+
+void CConnman::ThreadMessageHandler(int nShard)
 {
     while (!flagInterruptMsgProc)
     {
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
+            // Each peer is only ever handled by the thread owning its shard,
+            // so per-peer state in net_processing needs no extra locking.
+            for (CNode* pnode : vNodes) {
+                if (MessageHandlerShard(pnode) != nShard)
+                    continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
@@ -2014,7 +2286,10 @@ void CConnman::ThreadMessageHandler()
                 continue;
 
             // Receive messages
+            bool fPauseRecv = pnode->fPauseRecv;
             bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
+            if (pnode->fPauseRecv != fPauseRecv)
+                UpdateSocketEvents(pnode);
             fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
             if (flagInterruptMsgProc)
                 return;
@@ -2035,10 +2310,11 @@ void CConnman::ThreadMessageHandler()
         }
 
         std::unique_lock<std::mutex> lock(mutexMsgProc);
+        MessageHandlerWake& wake = *vMsgProcWake[nShard];
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            wake.cond.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [&wake] { return wake.fWake; });
         }
-        fMsgProcWake = false;
+        wake.fWake = false;
     }
 }
 
@@ -2205,6 +2481,9 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nReceiveFloodSize = 0;
     flagInterruptMsgProc = false;
     SetTryNewOutboundPeer(false);
+#ifdef USE_EPOLL
+    epollfd = -1;
+#endif
 
     Options connOptions;
     Init(connOptions);
@@ -2331,9 +2610,32 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
 
     {
         std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+        vMsgProcWake.clear();
+        for (int i = 0; i < nMsgHandThreads; i++)
+            vMsgProcWake.emplace_back(new MessageHandlerWake());
     }
 
+#ifdef USE_EPOLL
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd == -1) {
+        if (clientInterface) {
+            clientInterface->ThreadSafeMessageBox(
+                strprintf(_("Failed to create epoll instance: %s"), NetworkErrorString(errno)),
+                "", CClientUIInterface::MSG_ERROR);
+        }
+        return false;
+    }
+    for (ListenSocket& hListenSocket : vhListenSocket) {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = &hListenSocket;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+            LogPrintf("socket epoll add error %s\n", NetworkErrorString(errno));
+            return false;
+        }
+    }
+#endif
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2357,7 +2659,14 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    if (nMsgHandThreads > 1)
+        LogPrintf("Using %d message handler threads\n", nMsgHandThreads);
+    for (int i = 0; i < nMsgHandThreads; i++) {
+        std::string strName = nMsgHandThreads == 1 ? "msghand" : strprintf("msghand.%d", i);
+        threadMessageHandlers.emplace_back([this, i, strName] {
+            TraceThread(strName.c_str(), std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, i)));
+        });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
@@ -2385,8 +2694,9 @@ void CConnman::Interrupt()
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
         flagInterruptMsgProc = true;
+        for (const auto& wake : vMsgProcWake)
+            wake->cond.notify_all();
     }
-    condMsgProc.notify_all();
 
     interruptNet();
     InterruptSocks5(true);
@@ -2406,8 +2716,11 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2440,6 +2753,14 @@ void CConnman::Stop()
     }
     vNodes.clear();
     vNodesDisconnected.clear();
+#ifdef USE_EPOLL
+    // Only once no node is left to take its socket out of the set, so none
+    // calls epoll_ctl() on a closed or reused descriptor.
+    if (epollfd != -1) {
+        close(epollfd);
+        epollfd = -1;
+    }
+#endif
     vhListenSocket.clear();
     semOutbound.reset();
     semAddnode.reset();
@@ -2699,6 +3020,10 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
 {
     nServices = NODE_NONE;
     hSocket = hSocketIn;
+#ifdef USE_EPOLL
+    epollfd = -1;
+    nEpollEvents = 0;
+#endif
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
@@ -2829,8 +3154,10 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
             pnode->vSendMsg.push_back(std::move(msg.data));
 
         // If write queue empty, attempt "optimistic write"
-        if (optimisticSend == true)
+        if (optimisticSend == true) {
             nBytesSent = SocketSendData(pnode);
+            UpdateSocketEvents(pnode);
+        }
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
@@ -83,6 +83,10 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** The default number of message handler threads. Peers are sharded across them by NodeId. */
+static const int DEFAULT_MSGHAND_THREADS = 1;
+/** The maximum number of message handler threads */
+static const int MAX_MSGHAND_THREADS = 16;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
@@ -132,6 +136,7 @@ public:
         int nMaxOutbound = 0;
         int nMaxAddnode = 0;
         int nMaxFeeler = 0;
+        int nMsgHandThreads = DEFAULT_MSGHAND_THREADS;
         int nBestHeight = 0;
         CClientUIInterface* uiInterface = nullptr;
         NetEventsInterface* m_msgproc = nullptr;
@@ -153,6 +158,7 @@ public:
         nMaxOutbound = std::min(connOptions.nMaxOutbound, connOptions.nMaxConnections);
         nMaxAddnode = connOptions.nMaxAddnode;
         nMaxFeeler = connOptions.nMaxFeeler;
+        nMsgHandThreads = std::max(1, std::min(connOptions.nMsgHandThreads, MAX_MSGHAND_THREADS));
         nBestHeight = connOptions.nBestHeight;
         clientInterface = connOptions.uiInterface;
         m_msgproc = connOptions.m_msgproc;
@@ -313,7 +319,10 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake every message handler thread */
     void WakeMessageHandler();
+    /** Wake only the message handler thread that owns pnode */
+    void WakeMessageHandler(const CNode* pnode);
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -329,8 +338,27 @@ private:
     void AddOneShot(const std::string& strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nShard);
+    int MessageHandlerShard(const CNode* pnode) const;
+    /** A peer whose socket SocketEvents() found ready, referenced until the socket handler releases it */
+    struct NodeSocketEvents {
+        CNode* pnode;
+        bool fRecv;
+        bool fSend;
+        bool fError;
+    };
+
     void AcceptConnection(const ListenSocket& hListenSocket);
+    bool GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+    /** Wait for socket readiness and return the ready sockets, using epoll where available and select() otherwise */
+    void SocketEvents(std::vector<const ListenSocket*>& vListenReady, std::vector<NodeSocketEvents>& vNodeEvents);
+#ifdef USE_EPOLL
+    void SocketEventsEpoll(std::vector<const ListenSocket*>& vListenReady, std::vector<NodeSocketEvents>& vNodeEvents);
+#endif
+    /** Register the socket of pnode with epoll, or change the events it waits for after its send queue or fPauseRecv changed */
+    void UpdateSocketEvents(CNode* pnode);
+    /** Disconnect pnode if it has been silent or unresponsive for too long */
+    void InactivityCheck(CNode* pnode);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -387,6 +415,10 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+#ifdef USE_EPOLL
+    //! epoll instance of the socket handler
+    int epollfd;
+#endif
     std::atomic<bool> fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
@@ -411,6 +443,7 @@ private:
     int nMaxOutbound;
     int nMaxAddnode;
     int nMaxFeeler;
+    int nMsgHandThreads;
     std::atomic<int> nBestHeight;
     CClientUIInterface* clientInterface;
     NetEventsInterface* m_msgproc;
@@ -418,10 +451,14 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** Flag and condition variable for waking one message handler thread */
+    struct MessageHandlerWake {
+        bool fWake = false;
+        std::condition_variable cond;
+    };
 
-    std::condition_variable condMsgProc;
+    /** One per message handler thread, so a message only wakes the thread that handles its peer (guarded by mutexMsgProc) */
+    std::vector<std::unique_ptr<MessageHandlerWake>> vMsgProcWake;
     std::mutex mutexMsgProc;
     std::atomic<bool> flagInterruptMsgProc;
 
@@ -431,7 +468,7 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
@@ -560,7 +597,7 @@ private:
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
-    CDataStream hdrbuf;             // partially received header
+    char hdrbuf[CMessageHeader::HEADER_SIZE]; // partially received header
     CMessageHeader hdr;             // complete header
     unsigned int nHdrPos;
 
@@ -569,8 +606,7 @@ public:
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
@@ -588,12 +624,16 @@ public:
 
     void SetVersion(int nVersionIn)
     {
-        hdrbuf.SetVersion(nVersionIn);
         vRecv.SetVersion(nVersionIn);
     }
 
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+
+    /** Writable space in vRecv for up to nBytes more of the payload; nBytes is lowered to what fits. */
+    char* GetDataBuffer(unsigned int& nBytes);
+    /** Account for nBytes of payload written to the space returned by GetDataBuffer(). */
+    void DataReceived(unsigned int nBytes);
 };
 
 
@@ -611,6 +651,12 @@ public:
     std::deque<std::vector<unsigned char>> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
+#ifdef USE_EPOLL
+    //! epoll instance hSocket is registered with, -1 if none (protected by cs_hSocket)
+    int epollfd;
+    //! Events hSocket is registered for (protected by cs_hSocket)
+    uint32_t nEpollEvents;
+#endif
     CCriticalSection cs_vRecv;
 
     CCriticalSection cs_vProcessMsg;
@@ -670,8 +716,11 @@ public:
     std::atomic<int> nStartingHeight;
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    CRollingBloomFilter addrKnown;
+    // Address relay pushes to other peers' queues, so unlike the rest of the
+    // per-peer relay state these are shared between message handler threads.
+    CCriticalSection cs_addrToSend;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(cs_addrToSend);
+    CRollingBloomFilter addrKnown GUARDED_BY(cs_addrToSend);
     bool fGetAddr;
     std::set<uint256> setKnown;
     int64_t nNextAddrSend;
@@ -733,6 +782,7 @@ private:
     const int nMyStartingHeight;
     int nSendVersion;
     std::list<CNetMessage> vRecvMsg;  // Used only by SocketHandler thread
+    void MessageReceived(CNetMessage& msg, int64_t nTimeMicros);
 
     mutable CCriticalSection cs_addrName;
     std::string addrName;
@@ -761,6 +811,14 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    /**
+     * Space to recv() the rest of a large in-progress message payload into
+     * directly, skipping the copy through the socket handler's buffer.
+     * Returns nullptr if no large payload is being received.
+     */
+    char* GetRecvPayloadBuffer(unsigned int& nBytes);
+    /** Account for nBytes received into the space returned by GetRecvPayloadBuffer(). */
+    void ReceivedPayloadBytes(unsigned int nBytes, bool& complete);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -792,6 +850,7 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_addrToSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -800,6 +859,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_addrToSend);
         if (_addr.IsValid() && !addrKnown.contains(_addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.randrange(vAddrToSend.size())] = _addr;
@@ -10,8 +10,11 @@
 #include <arith_uint256.h>
 #include <chain.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <uint256.h>
 
+#include <vector>
+
 unsigned int GetNextWorkRequired_BTC(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
     assert(pindexLast != nullptr);
@@ -48,6 +51,102 @@ unsigned int GetNextWorkRequired_BTC(const CBlockIndex* pindexLast, const CBlock
     return CalculateNextWorkRequired_BTC(pindexLast, pindexFirst->GetBlockTime(), params);
 }
 
+namespace {
+/**
+ * Rolling sum of the targets in the averaging window ending at a recently
+ * seen block. Moving the window one block forward drops the oldest target and
+ * adds the new one, so following the header tip or the active tip costs a
+ * single SetCompact instead of nPowAveragingWindow of them. Windows are keyed
+ * by block hash rather than CBlockIndex pointer, so entries freed and reused
+ * by a block index reload can never alias a stale window.
+ */
+struct CAveragingWindow
+{
+    uint256 hashLast;
+    int64_t nWindow = 0;
+    //! Ring buffer of targets, vTargets[nOldest] is the next one to leave the window
+    std::vector<arith_uint256> vTargets;
+    size_t nOldest = 0;
+    arith_uint256 bnTot;
+    uint64_t nLastUsed = 0;
+};
+
+CCriticalSection cs_averagingwindow;
+//! One window usually follows the header tip, the other the active tip (block templates).
+CAveragingWindow averagingWindows[2] GUARDED_BY(cs_averagingwindow);
+uint64_t nAveragingWindowClock GUARDED_BY(cs_averagingwindow) = 0;
+} // namespace
+
+bool GetAveragingWindowSum(const CBlockIndex* pindexLast, const Consensus::Params& params, arith_uint256& bnTot)
+{
+    const CBlockIndex* pindexFirst = pindexLast;
+    bnTot = 0;
+    for (int i = 0; pindexFirst && i < params.nPowAveragingWindow; i++) {
+        arith_uint256 bnTmp;
+        bnTmp.SetCompact(pindexFirst->nBits);
+        bnTot += bnTmp;
+        pindexFirst = pindexFirst->pprev;
+    }
+    return pindexFirst != nullptr;
+}
+
+bool GetAveragingWindowSumCached(const CBlockIndex* pindexLast, const Consensus::Params& params, arith_uint256& bnTot)
+{
+    // Short chains, and entries without a hash (unit tests), always take the full walk.
+    if (pindexLast->nHeight < params.nPowAveragingWindow || !pindexLast->phashBlock || !pindexLast->pprev->phashBlock)
+        return GetAveragingWindowSum(pindexLast, params, bnTot);
+
+    const uint256& hashLast = pindexLast->GetBlockHash();
+    const uint256& hashPrev = pindexLast->pprev->GetBlockHash();
+
+    LOCK(cs_averagingwindow);
+    CAveragingWindow* pwindow = nullptr;
+    for (CAveragingWindow& window : averagingWindows) {
+        if (window.nWindow == params.nPowAveragingWindow && window.hashLast == hashLast) {
+            pwindow = &window;
+            break;
+        }
+    }
+    if (!pwindow) {
+        for (CAveragingWindow& window : averagingWindows) {
+            if (window.nWindow == params.nPowAveragingWindow && window.hashLast == hashPrev) {
+                // pindexLast extends this window: slide it forward by one block.
+                arith_uint256 bnNew;
+                bnNew.SetCompact(pindexLast->nBits);
+                window.bnTot -= window.vTargets[window.nOldest];
+                window.bnTot += bnNew;
+                window.vTargets[window.nOldest] = bnNew;
+                window.nOldest = (window.nOldest + 1) % window.vTargets.size();
+                window.hashLast = hashLast;
+                pwindow = &window;
+                break;
+            }
+        }
+    }
+    if (!pwindow) {
+        // First use or reorg: rebuild the least recently used window with the full walk.
+        pwindow = &averagingWindows[0];
+        for (CAveragingWindow& window : averagingWindows) {
+            if (window.nLastUsed < pwindow->nLastUsed) pwindow = &window;
+        }
+        pwindow->vTargets.resize(params.nPowAveragingWindow);
+        pwindow->bnTot = 0;
+        const CBlockIndex* pindex = pindexLast;
+        for (int64_t i = params.nPowAveragingWindow - 1; i >= 0; i--) {
+            pwindow->vTargets[i].SetCompact(pindex->nBits);
+            pwindow->bnTot += pwindow->vTargets[i];
+            pindex = pindex->pprev;
+        }
+        pwindow->nOldest = 0;
+        pwindow->nWindow = params.nPowAveragingWindow;
+        pwindow->hashLast = hashLast;
+    }
+
+    pwindow->nLastUsed = ++nAveragingWindowClock;
+    bnTot = pwindow->bnTot;
+    return true;
+}
+
 // DigiShieldZEC
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
@@ -71,20 +170,15 @@ unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHead
         }
     }
 
-    // Find the first block in the averaging interval
-    const CBlockIndex* pindexFirst = pindexLast;
+    // Sum the targets over the averaging interval
     arith_uint256 bnTot {0};
-    for (int i = 0; pindexFirst && i < params.nPowAveragingWindow; i++) {
-        arith_uint256 bnTmp;
-        bnTmp.SetCompact(pindexFirst->nBits);
-        bnTot += bnTmp;
-        pindexFirst = pindexFirst->pprev;
-    }
-
-    // Check we have enough blocks
-    if (pindexFirst == nullptr) // FIXME.SUGAR // SURE? // <chain.cpp>
+    if (!GetAveragingWindowSumCached(pindexLast, params, bnTot)) // Check we have enough blocks
         return nProofOfWorkLimit;
 
+    // Find the first block in the averaging interval
+    const CBlockIndex* pindexFirst = pindexLast->GetAncestor(pindexLast->nHeight - params.nPowAveragingWindow);
+    assert(pindexFirst);
+
     arith_uint256 bnAvg {bnTot / params.nPowAveragingWindow};
 
     // FIXME.SUGAR // SURE?
@@ -25,7 +25,20 @@ unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHead
 unsigned int CalculateNextWorkRequired(arith_uint256 bnAvg,
                                        int64_t nLastBlockTime, int64_t nFirstBlockTime,
                                        const Consensus::Params&);
-                                       
+
+/**
+ * Sum of the targets of the nPowAveragingWindow blocks ending at pindexLast,
+ * found by walking the whole window. Returns false if the chain is shorter
+ * than the window.
+ */
+bool GetAveragingWindowSum(const CBlockIndex* pindexLast, const Consensus::Params&, arith_uint256& bnTot);
+/**
+ * Same as GetAveragingWindowSum, but served from a small rolling cache. O(1)
+ * when pindexLast is, or directly extends, a recently summed window; falls
+ * back to the full walk otherwise (first use, reorgs).
+ */
+bool GetAveragingWindowSumCached(const CBlockIndex* pindexLast, const Consensus::Params&, arith_uint256& bnTot);
+
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
 
@@ -0,0 +1,153 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PREFETCHQUEUE_H
+#define BITCOIN_PREFETCHQUEUE_H
+
+#include <assert.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * Worker threads shared by every CPrefetchQueue. The threads are started
+ * once, like the script-checking ones, and each runs Thread() until it is
+ * interrupted.
+ */
+class CPrefetchPool
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<std::function<void()>> tasks;
+
+public:
+    /** Run tasks as they are pushed; returns when the thread is interrupted */
+    void Thread()
+    {
+        while (true) {
+            std::function<void()> task;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (tasks.empty())
+                    cond.wait(lock); // interruption point
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    void Push(std::function<void()> task)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        cond.notify_one();
+    }
+};
+
+/**
+ * Queue of jobs that produce values, such as reading and deserializing the
+ * next blocks, which are run on a CPrefetchPool ahead of a single consumer
+ * that takes their results in the order the jobs were pushed.
+ *
+ * The consumer bounds how far ahead work runs by how many jobs it keeps
+ * queued. When it pops a job no worker has started yet, it runs the job
+ * itself rather than waiting, so without a pool the queue simply runs every
+ * job on pop. Jobs must not throw.
+ */
+template <typename T>
+class CPrefetchQueue
+{
+private:
+    struct Job
+    {
+        std::function<T()> fn;
+        bool fStarted = false;
+        bool fDone = false;
+        T result;
+    };
+
+    //! Shared with the pool's tasks, which may run after the queue is gone
+    struct State
+    {
+        std::mutex mutex;
+        std::condition_variable cond;
+    };
+
+    CPrefetchPool* const ppool;
+    const std::shared_ptr<State> state;
+    //! Queued jobs, oldest first; only touched by the consumer
+    std::deque<std::shared_ptr<Job>> queue;
+
+public:
+    explicit CPrefetchQueue(CPrefetchPool* ppoolIn) : ppool(ppoolIn), state(std::make_shared<State>()) {}
+
+    ~CPrefetchQueue() { Clear(); }
+
+    CPrefetchQueue(const CPrefetchQueue&) = delete;
+    CPrefetchQueue& operator=(const CPrefetchQueue&) = delete;
+
+    void Push(std::function<T()> fn)
+    {
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->fn = std::move(fn);
+        queue.push_back(job);
+        if (!ppool)
+            return;
+        std::shared_ptr<State> stateJob = state;
+        ppool->Push([stateJob, job] {
+            {
+                std::lock_guard<std::mutex> lock(stateJob->mutex);
+                if (job->fStarted) // popped or dropped already
+                    return;
+                job->fStarted = true;
+            }
+            T result = job->fn();
+            std::lock_guard<std::mutex> lock(stateJob->mutex);
+            job->result = std::move(result);
+            job->fDone = true;
+            stateJob->cond.notify_all();
+        });
+    }
+
+    /** Return the result of the oldest queued job, waiting for it if needed. */
+    T Pop()
+    {
+        assert(!queue.empty());
+        std::shared_ptr<Job> job = std::move(queue.front());
+        queue.pop_front();
+        std::unique_lock<std::mutex> lock(state->mutex);
+        if (!job->fStarted) {
+            job->fStarted = true;
+            lock.unlock();
+            return job->fn();
+        }
+        state->cond.wait(lock, [&job] { return job->fDone; });
+        return std::move(job->result);
+    }
+
+    /** Drop all queued jobs. Jobs already running finish, but their results are discarded. */
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        for (const std::shared_ptr<Job>& job : queue)
+            job->fStarted = true;
+        queue.clear();
+    }
+
+    size_t size() const { return queue.size(); }
+
+    bool empty() const { return queue.empty(); }
+};
+
+#endif // BITCOIN_PREFETCHQUEUE_H
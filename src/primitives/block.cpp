@@ -12,7 +12,7 @@
 #include <crypto/common.h>
 
 // yespower
-#include <crypto/yespower-1.0.1/yespower.h>
+#include <crypto/yespower.h>
 #include <streams.h>
 #include <version.h>
 
@@ -30,13 +30,6 @@ uint256 CBlockHeaderUncached::GetHash() const
 // yespowerUncached
 uint256 CBlockHeaderUncached::GetPoWHash() const
 {
-    static const yespower_params_t yespower_1_0_sugarchain = {
-        .version = YESPOWER_1_0,
-        .N = 2048,
-        .r = 32,
-        .pers = (const uint8_t *)"Satoshi Nakamoto 31/Oct/2008 Proof-of-work is essentially one-CPU-one-vote",
-        .perslen = 74
-    };
     uint256 hash;
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
     ss << *this;
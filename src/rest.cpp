@@ -210,6 +210,10 @@ static bool rest_block(HTTPRequest* req,
 
     CBlock block;
     CBlockIndex* pblockindex = nullptr;
+    // Binary and hex replies with witness data are the block exactly as
+    // stored on disk, so they skip deserializing it.
+    const bool fRaw = (rf == RF_BINARY || rf == RF_HEX) && RPCSerializationFlags() == 0;
+    std::vector<unsigned char> blockData;
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
@@ -219,23 +223,29 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        if (fRaw) {
+            if (!ReadRawBlockFromDisk(blockData, pblockindex, Params().MessageStart()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        } else if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())) {
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        }
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ssBlock << block;
+    if (!fRaw && rf != RF_JSON) {
+        CVectorWriter ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), blockData, 0);
+        ssBlock << block;
+    }
 
     switch (rf) {
     case RF_BINARY: {
-        std::string binaryBlock = ssBlock.str();
+        std::string binaryBlock(blockData.begin(), blockData.end());
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RF_HEX: {
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        std::string strHex = HexStr(blockData.begin(), blockData.end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
@@ -23,6 +23,7 @@
 #include <txmempool.h>
 #include <util.h>
 #include <utilstrencodings.h>
+#include <utxosnapshot.h>
 #include <hash.h>
 #include <validationinterface.h>
 #include <warnings.h>
@@ -823,59 +824,35 @@ struct CCoinsStats
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
 };
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
-{
-    assert(!outputs.empty());
-    ss << hash;
-    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
-    stats.nTransactions++;
-    for (const auto output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << output.second.out.scriptPubKey;
-        ss << VARINT(output.second.out.nValue);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
-        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
-                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
-    }
-    ss << VARINT(0);
-}
-
 //! Calculate statistics about the unspent transaction output set
 static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
 {
     std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
+    if (!pcursor)
+        return false;
 
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = pcursor->GetBestBlock();
     {
         LOCK(cs_main);
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
     }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
+    CUTXOSetHasher hasher(stats.hashBlock);
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         COutPoint key;
         Coin coin;
         if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
+            hasher.Add(key, std::move(coin));
         } else {
             return error("%s: unable to read value", __func__);
         }
         pcursor->Next();
     }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
-    }
-    stats.hashSerialized = ss.GetHash();
+    stats.hashSerialized = hasher.GetHash();
+    stats.nTransactions = hasher.nTransactions;
+    stats.nTransactionOutputs = hasher.nTransactionOutputs;
+    stats.nBogoSize = hasher.nBogoSize;
+    stats.nTotalAmount = hasher.nTotalAmount;
     stats.nDiskSize = view->EstimateSize();
     return true;
 }
@@ -1407,6 +1384,38 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+UniValue getpowcacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getpowcacheinfo\n"
+            "\nReturns details on the on-disk PoW hash cache (see -powcache).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,      (boolean) Whether the cache is in use\n"
+            "  \"hits\": xxxxx,              (numeric) Lookups since startup that found the PoW hash on disk\n"
+            "  \"misses\": xxxxx,            (numeric) Lookups since startup that had to compute yespower\n"
+            "  \"hitrate\": x.xx,            (numeric) hits / (hits + misses), 0 if there were no lookups\n"
+            "  \"size_on_disk\": xxxxx       (numeric) Estimated size of the cache database in bytes\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getpowcacheinfo", "")
+            + HelpExampleRpc("getpowcacheinfo", "")
+        );
+
+    uint64_t nHits, nMisses;
+    size_t nSizeOnDisk;
+    bool fEnabled = GetPoWCacheStats(nHits, nMisses, nSizeOnDisk);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("enabled", fEnabled));
+    ret.push_back(Pair("hits", nHits));
+    ret.push_back(Pair("misses", nMisses));
+    ret.push_back(Pair("hitrate", nHits + nMisses ? (double)nHits / (nHits + nMisses) : 0.0));
+    ret.push_back(Pair("size_on_disk", (uint64_t)nSizeOnDisk));
+    return ret;
+}
+
 UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1618,9 +1627,66 @@ UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the unspent transaction output set at the tip to a snapshot. Its hash_serialized_2 can be\n"
+            "checked against gettxoutsetinfo of any node at the same block.\n"
+            "Note a node can't be started from a snapshot yet.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write to, relative to the data directory unless absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,       (numeric) The number of coins in the snapshot\n"
+            "  \"base_hash\": \"hex\",       (string) The hash of the block the snapshot was taken at\n"
+            "  \"base_height\": n,         (numeric) The height of that block\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The hash of the set, as gettxoutsetinfo reports it\n"
+            "  \"path\": \"path\"            (string) The absolute path of the snapshot\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    // The cursor reads a consistent view of the flushed chainstate, so blocks
+    // can be connected while the snapshot is written.
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    CUTXOSnapshotHeader header;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(pcoinsdbview->Cursor());
+        if (!pcursor)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        const CBlockIndex* pindex = mapBlockIndex.find(pcursor->GetBestBlock())->second;
+        header.hashBlock = pindex->GetBlockHash();
+        header.nHeight = pindex->nHeight;
+        header.nTx = pindex->nTx;
+        header.nChainTx = pindex->nChainTx;
+    }
+    if (!WriteUTXOSnapshot(pcursor.get(), header, path))
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write UTXO snapshot");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_written", header.nCoins));
+    ret.push_back(Pair("base_hash", header.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", header.nHeight));
+    ret.push_back(Pair("hash_serialized_2", header.hashSerialized.GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
@@ -1634,6 +1700,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
+    { "blockchain",         "getpowcacheinfo",        &getpowcacheinfo,        {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
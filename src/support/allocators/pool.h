@@ -0,0 +1,173 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <memory>
+#include <new>
+#include <vector>
+
+/**
+ * Memory resource serving small allocations from large chunks, with a free
+ * list for every size up to MAX_BLOCK_SIZE_BYTES in steps of ALIGN_BYTES.
+ *
+ * This suits node-based containers, which allocate one node at a time: the
+ * nodes sit next to each other rather than all over the heap, and don't each
+ * pay malloc's bookkeeping overhead. Freed blocks are reused for allocations
+ * of the same size before anything new is carved out, and chunks are only
+ * given back when the resource is destroyed. So it holds exactly
+ * NumAllocatedChunks() chunks of ChunkSizeBytes(), of which UnusedBytes() are
+ * ready for reuse. Bigger or more aligned allocations go to operator new.
+ *
+ * Not thread-safe.
+ */
+template <size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+class PoolResource
+{
+    static_assert(ALIGN_BYTES >= sizeof(void*) && (ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two that fits a pointer");
+    static_assert(ALIGN_BYTES <= alignof(max_align_t), "chunks are only aligned for fundamental types");
+
+private:
+    //! A freed block, linked into the free list of its size
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    static const size_t NUM_SIZES = MAX_BLOCK_SIZE_BYTES / ALIGN_BYTES + 1;
+
+    const size_t nChunkSizeBytes;
+    std::vector<std::unique_ptr<char[]>> vChunks;
+    //! The part of the newest chunk not handed out yet
+    char* pChunkFree = nullptr;
+    char* pChunkEnd = nullptr;
+    //! Free lists, indexed by block size in units of ALIGN_BYTES
+    FreeBlock* vFree[NUM_SIZES] = {};
+    size_t nFreeBytes = 0;
+
+    static bool IsPooled(size_t bytes, size_t align)
+    {
+        return bytes <= MAX_BLOCK_SIZE_BYTES && align <= ALIGN_BYTES;
+    }
+
+    static size_t SizeIndex(size_t bytes)
+    {
+        return bytes == 0 ? 1 : (bytes + ALIGN_BYTES - 1) / ALIGN_BYTES;
+    }
+
+    void PushFree(void* p, size_t nIndex)
+    {
+        vFree[nIndex] = new (p) FreeBlock{vFree[nIndex]};
+        nFreeBytes += nIndex * ALIGN_BYTES;
+    }
+
+    void AllocateChunk()
+    {
+        // Keep what's left of the current chunk for allocations that fit it
+        size_t nLeft = pChunkEnd - pChunkFree;
+        if (nLeft >= ALIGN_BYTES)
+            PushFree(pChunkFree, nLeft / ALIGN_BYTES);
+        vChunks.emplace_back(new char[nChunkSizeBytes]);
+        pChunkFree = vChunks.back().get();
+        pChunkEnd = pChunkFree + nChunkSizeBytes;
+    }
+
+public:
+    explicit PoolResource(size_t nChunkSizeBytesIn = 256 * 1024) : nChunkSizeBytes(nChunkSizeBytesIn)
+    {
+        assert(nChunkSizeBytes >= MAX_BLOCK_SIZE_BYTES);
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    void* Allocate(size_t bytes, size_t align)
+    {
+        if (!IsPooled(bytes, align))
+            return ::operator new(bytes);
+        size_t nIndex = SizeIndex(bytes);
+        if (vFree[nIndex]) {
+            FreeBlock* block = vFree[nIndex];
+            vFree[nIndex] = block->next;
+            block->~FreeBlock();
+            nFreeBytes -= nIndex * ALIGN_BYTES;
+            return block;
+        }
+        size_t nBlockBytes = nIndex * ALIGN_BYTES;
+        if ((size_t)(pChunkEnd - pChunkFree) < nBlockBytes)
+            AllocateChunk();
+        void* p = pChunkFree;
+        pChunkFree += nBlockBytes;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t bytes, size_t align) noexcept
+    {
+        if (IsPooled(bytes, align))
+            PushFree(p, SizeIndex(bytes));
+        else
+            ::operator delete(p);
+    }
+
+    size_t ChunkSizeBytes() const { return nChunkSizeBytes; }
+    size_t NumAllocatedChunks() const { return vChunks.size(); }
+    //! Bytes of the chunks not handed out, or given back
+    size_t UnusedBytes() const { return nFreeBytes + (pChunkEnd - pChunkFree); }
+};
+
+/**
+ * Allocator handing out memory from a PoolResource, for containers whose
+ * memory should come from one. The resource must outlive the container.
+ */
+template <typename T, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    // Not explicit, so containers can be constructed straight from a resource
+    PoolAllocator(ResourceType* resourceIn) noexcept : resource(resourceIn) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : resource(other.Resource()) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType* Resource() const noexcept { return resource; }
+
+private:
+    ResourceType* resource;
+};
+
+template <typename T, typename U, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return a.Resource() == b.Resource();
+}
+
+template <typename T, typename U, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
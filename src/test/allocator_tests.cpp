@@ -4,10 +4,13 @@
 
 #include <util.h>
 
+#include <support/allocators/pool.h>
 #include <support/allocators/secure.h>
 #include <test/test_bitcoin.h>
 
 #include <memory>
+#include <set>
+#include <unordered_map>
 
 #include <boost/test/unit_test.hpp>
 
@@ -233,4 +236,62 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(poolresource_tests)
+{
+    PoolResource<64, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+    // Small blocks are carved from one chunk, aligned and without overlap
+    std::set<uintptr_t> blocks;
+    for (int i = 0; i < 32; ++i) {
+        void* p = resource.Allocate(24, 8);
+        BOOST_CHECK_EQUAL((uintptr_t)p % 8, 0U);
+        memset(p, 0xAA, 24);
+        blocks.insert((uintptr_t)p);
+    }
+    BOOST_CHECK_EQUAL(blocks.size(), 32U);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // A freed block is handed out again for the next allocation of its size
+    void* p = (void*)*blocks.begin();
+    size_t nUnused = resource.UnusedBytes();
+    resource.Deallocate(p, 24, 8);
+    BOOST_CHECK_EQUAL(resource.UnusedBytes(), nUnused + 24);
+    BOOST_CHECK(resource.Allocate(40, 8) != p);
+    BOOST_CHECK(resource.Allocate(24, 8) == p);
+
+    // Running out of a chunk allocates another one
+    for (int i = 0; i < 16; ++i)
+        resource.Allocate(64, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+
+    // Blocks too large or too aligned for the pool bypass it
+    void* big = resource.Allocate(65, 8);
+    void* aligned = resource.Allocate(8, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    resource.Deallocate(big, 65, 8);
+    resource.Deallocate(aligned, 8, 16);
+}
+
+BOOST_AUTO_TEST_CASE(poolallocator_unordered_map_tests)
+{
+    typedef PoolAllocator<std::pair<const int, int>, 64, 8> Allocator;
+    Allocator::ResourceType resource;
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, Allocator> map(0, std::hash<int>(), std::equal_to<int>(), &resource);
+    for (int i = 0; i < 10000; ++i)
+        map[i] = i * 2;
+    for (int i = 0; i < 10000; i += 2)
+        map.erase(i);
+    size_t nChunks = resource.NumAllocatedChunks();
+    BOOST_CHECK(nChunks > 0);
+    // Nodes freed by the erases are reused, so refilling needs no new chunk
+    for (int i = 0; i < 10000; i += 2)
+        map[i] = i;
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), nChunks);
+    BOOST_CHECK_EQUAL(map.size(), 10000U);
+    for (int i = 0; i < 10000; ++i)
+        BOOST_CHECK_EQUAL(map.at(i), i % 2 ? i * 2 : i);
+    BOOST_CHECK(map.get_allocator() == Allocator(&resource));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,82 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+#include <fs.h>
+#include <test/test_bitcoin.h>
+
+#include <string.h>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, BasicTestingSetup)
+
+#ifndef WIN32
+static void AppendToFile(const fs::path& path, const std::vector<unsigned char>& data)
+{
+    FILE* file = fsbridge::fopen(path, "ab");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_append)
+{
+    const fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+    const fs::path path = dir / "blk00000.dat";
+    const std::vector<unsigned char> first(100, 0x11), second(100, 0x22);
+    CBlockFileMap map(2);
+
+    BOOST_CHECK(!map.Get(path, 0));
+    AppendToFile(path, first);
+    std::shared_ptr<const CMappedFile> mapped = map.Get(path, first.size());
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK_EQUAL(mapped->size(), first.size());
+    BOOST_CHECK(memcmp(mapped->data(), first.data(), first.size()) == 0);
+    BOOST_CHECK(map.Get(path, first.size()) == mapped);
+    BOOST_CHECK(!map.Get(path, first.size() + 1));
+
+    // Once the file grows the mapping is replaced, and the old one stays usable
+    AppendToFile(path, second);
+    std::shared_ptr<const CMappedFile> remapped = map.Get(path, first.size() + second.size());
+    BOOST_REQUIRE(remapped);
+    BOOST_CHECK(remapped != mapped);
+    BOOST_CHECK(memcmp(remapped->data() + first.size(), second.data(), second.size()) == 0);
+    BOOST_CHECK(memcmp(mapped->data(), first.data(), first.size()) == 0);
+    BOOST_CHECK(map.Get(path, first.size()) == remapped);
+
+    map.Forget(path);
+    BOOST_CHECK(map.Get(path, first.size()) != remapped);
+    fs::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_lru)
+{
+    const fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+    const std::vector<unsigned char> data(10, 0x33);
+    std::vector<fs::path> paths;
+    for (int i = 0; i < 3; i++) {
+        paths.push_back(dir / strprintf("blk%05u.dat", i));
+        AppendToFile(paths.back(), data);
+    }
+    CBlockFileMap map(2);
+
+    std::shared_ptr<const CMappedFile> mapped0 = map.Get(paths[0], 1);
+    std::shared_ptr<const CMappedFile> mapped1 = map.Get(paths[1], 1);
+    BOOST_CHECK(map.Get(paths[0], 1) == mapped0);
+    // Mapping a third file evicts the least recently used one
+    map.Get(paths[2], 1);
+    BOOST_CHECK(map.Get(paths[0], 1) == mapped0);
+    BOOST_CHECK(map.Get(paths[1], 1) != mapped1);
+
+    map.SetMaxFiles(0);
+    BOOST_CHECK(!map.Get(paths[0], 1));
+    fs::remove_all(dir);
+}
+#endif // WIN32
+
+BOOST_AUTO_TEST_SUITE_END()
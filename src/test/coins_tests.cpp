@@ -2,12 +2,14 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <checkqueue.h>
 #include <coins.h>
 #include <script/standard.h>
 #include <uint256.h>
 #include <undo.h>
 #include <utilstrencodings.h>
 #include <test/test_bitcoin.h>
+#include <txdb.h>
 #include <validation.h>
 #include <consensus/validation.h>
 
@@ -15,6 +17,7 @@
 #include <map>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
 
 int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out);
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight);
@@ -52,7 +55,7 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase) override
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -63,7 +66,10 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
+            if (erase)
+                mapCoins.erase(it++);
+            else
+                ++it;
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
@@ -207,10 +213,17 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
         }
 
         if (InsecureRandRange(100) == 0) {
-            // Every 100 iterations, flush an intermediate cache
+            // Every 100 iterations, flush or sync an intermediate cache,
+            // and maybe trim it
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
-                stack[flushIndex]->Flush();
+                if (InsecureRandBool()) {
+                    stack[flushIndex]->Flush();
+                } else {
+                    stack[flushIndex]->Sync();
+                    if (InsecureRandBool())
+                        stack[flushIndex]->Trim(InsecureRandRange(stack[flushIndex]->DynamicMemoryUsage() + 1));
+                }
             }
         }
         if (InsecureRandRange(100) == 0) {
@@ -579,14 +592,15 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
         } else {
             value = it->second.coin.out.nValue;
         }
-        flags = it->second.flags;
+        flags = it->second.flags & ~CCoinsCacheEntry::USED;
         assert(flags != NO_ENTRY);
     }
 }
 
 void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
     InsertCoinsMapEntry(map, value, flags);
     view.BatchWrite(map, {});
 }
@@ -855,4 +869,234 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+
+//! Adds one coin over its backing view, like CCoinsViewMemPool, by overriding GetCoin only
+class CCoinsViewOverlayTest : public CCoinsViewBacked
+{
+public:
+    COutPoint outpoint;
+    Coin coin;
+
+    explicit CCoinsViewOverlayTest(CCoinsView* viewIn) : CCoinsViewBacked(viewIn) {}
+
+    bool GetCoin(const COutPoint& outpointIn, Coin& coinOut) const override
+    {
+        if (outpointIn == outpoint) {
+            coinOut = coin;
+            return true;
+        }
+        return base->GetCoin(outpointIn, coinOut);
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(ccoins_getcoins, TestingSetup)
+{
+    CCoinsViewDB db(1 << 20, true);
+    std::vector<COutPoint> outpoints;
+    {
+        CCoinsViewCacheTest cache(&db);
+        for (int i = 0; i < 200; i++) {
+            outpoints.emplace_back(InsecureRand256(), i);
+            // Leave every third outpoint out of the database
+            if (i % 3 == 0) continue;
+            Coin coin;
+            coin.out.nValue = i + 1;
+            coin.out.scriptPubKey.assign(1 + InsecureRandBits(4), 0);
+            coin.nHeight = i;
+            cache.AddCoin(outpoints.back(), std::move(coin), false);
+        }
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+    outpoints.push_back(outpoints[1]);
+
+    CCheckQueue<CCoinsFetch> queue(MIN_COINS_PER_FETCH_THREAD);
+    boost::thread_group tg;
+    for (int i = 0; i < 3; i++)
+        tg.create_thread([&]{ queue.Thread(); });
+
+    // Batched reads, on worker threads or not, match single ones
+    for (CCheckQueue<CCoinsFetch>* pqueue : {(CCheckQueue<CCoinsFetch>*)nullptr, &queue}) {
+        std::vector<Coin> coins;
+        db.GetCoins(outpoints, coins, pqueue);
+        BOOST_CHECK_EQUAL(coins.size(), outpoints.size());
+        for (size_t i = 0; i < outpoints.size(); i++) {
+            Coin coin;
+            BOOST_CHECK_EQUAL(db.GetCoin(outpoints[i], coin), !coins[i].IsSpent());
+            BOOST_CHECK(coins[i] == coin);
+        }
+    }
+
+    // Prefetching through a stack of caches, with one coin already cached on top
+    CCoinsViewCacheTest base(&db);
+    CCoinsViewCacheTest top(&base);
+    top.AccessCoin(outpoints[2]);
+    top.PrefetchCoins(outpoints, &queue);
+    base.SelfTest();
+    top.SelfTest();
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        Coin coin;
+        BOOST_CHECK_EQUAL(top.HaveCoinInCache(outpoints[i]), db.GetCoin(outpoints[i], coin));
+        BOOST_CHECK(top.AccessCoin(outpoints[i]) == coin);
+    }
+
+    // A batch read through a view that only overrides GetCoin still goes through it
+    CCoinsViewOverlayTest overlay(&db);
+    overlay.outpoint = outpoints[0];
+    overlay.coin.out.nValue = 1000;
+    overlay.coin.nHeight = 1;
+    CCoinsViewCacheTest cacheOverlay(&overlay);
+    cacheOverlay.PrefetchCoins(outpoints, &queue);
+    BOOST_CHECK(cacheOverlay.HaveCoinInCache(outpoints[0]));
+    BOOST_CHECK(cacheOverlay.AccessCoin(outpoints[0]) == overlay.coin);
+    for (size_t i = 1; i < outpoints.size(); i++) {
+        Coin coin;
+        BOOST_CHECK_EQUAL(cacheOverlay.HaveCoinInCache(outpoints[i]), db.GetCoin(outpoints[i], coin));
+    }
+
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_flush_memory)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    size_t nEmptyUsage = cache.DynamicMemoryUsage();
+    for (int i = 0; i < 20000; i++) {
+        Coin coin;
+        coin.out.nValue = i + 1;
+        coin.out.scriptPubKey.assign(1 + InsecureRandBits(4), 0);
+        cache.AddCoin(COutPoint(InsecureRand256(), i), std::move(coin), false);
+    }
+    cache.SelfTest();
+    // The node pool's chunks dominate, and are all accounted for
+    size_t nFullUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(nFullUsage > nEmptyUsage + 20000 * sizeof(CCoinsMapValue));
+
+    // Flushing gives the chunks back instead of keeping them for reuse
+    BOOST_CHECK(cache.Flush());
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), nEmptyUsage);
+}
+
+BOOST_FIXTURE_TEST_CASE(ccoins_background_write, TestingSetup)
+{
+    // Small batches, so the writer commits in several steps
+    gArgs.ForceSetArg("-dbbatchsize", "1024");
+    CCoinsViewDB db(1 << 20, true, false, true);
+    std::map<COutPoint, Coin> expected;
+    for (int nFlush = 0; nFlush < 5; nFlush++) {
+        CCoinsViewCacheTest cache(&db);
+        for (auto it = expected.begin(); it != expected.end();) {
+            // Spend a third of what the earlier flushes wrote
+            if (InsecureRandRange(3) == 0) {
+                BOOST_CHECK(cache.SpendCoin(it->first));
+                it = expected.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (int i = 0; i < 500; i++) {
+            COutPoint outpoint(InsecureRand256(), i);
+            Coin coin;
+            coin.out.nValue = 1 + InsecureRandRange(COIN);
+            coin.out.scriptPubKey.assign(1 + InsecureRandBits(4), 0);
+            coin.nHeight = nFlush;
+            expected[outpoint] = coin;
+            cache.AddCoin(outpoint, std::move(coin), false);
+        }
+        uint256 hashBlock = InsecureRand256();
+        cache.SetBestBlock(hashBlock);
+        // A synced cache keeps its coins, so they are copied for the writer
+        BOOST_CHECK(nFlush % 2 ? cache.Sync() : cache.Flush());
+
+        // Whether or not the write is done, the view reflects it
+        BOOST_CHECK(db.GetBestBlock() == hashBlock);
+        for (const auto& entry : expected) {
+            Coin coin;
+            BOOST_CHECK(db.GetCoin(entry.first, coin));
+            BOOST_CHECK(coin == entry.second);
+        }
+        BOOST_CHECK(db.Sync());
+        BOOST_CHECK(!db.IsWriting());
+        BOOST_CHECK(db.GetHeadBlocks().empty());
+        BOOST_CHECK(db.GetBestBlock() == hashBlock);
+    }
+
+    // Everything reached the database itself
+    std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+    size_t count = 0;
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_CHECK(cursor->GetKey(outpoint) && cursor->GetValue(coin));
+        BOOST_CHECK(expected.count(outpoint) && expected[outpoint] == coin);
+        count++;
+    }
+    BOOST_CHECK_EQUAL(count, expected.size());
+    gArgs.ForceSetArg("-dbbatchsize", strprintf("%d", nDefaultDbBatchSize));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_sync_trim)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 1000; i++) {
+        outpoints.emplace_back(InsecureRand256(), i);
+        Coin coin;
+        coin.out.nValue = i + 1;
+        coin.out.scriptPubKey.assign(1 + InsecureRandBits(4), 0);
+        cache.AddCoin(outpoints.back(), std::move(coin), false);
+    }
+    // Spent before being written: dropped without reaching the base
+    BOOST_CHECK(cache.SpendCoin(outpoints[0]));
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), outpoints.size() - 1);
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 0U);
+    BOOST_CHECK(cache.SpendCoin(outpoints[1]));
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 1U);
+
+    // Synced coins are in the base and stay cached, unmodified
+    BOOST_CHECK(base.GetBestBlock() == cache.GetBestBlock());
+    BOOST_CHECK(!base.HaveCoin(outpoints[0]));
+    for (size_t i = 1; i < outpoints.size(); i++) {
+        BOOST_CHECK(base.HaveCoin(outpoints[i]));
+        auto it = cache.map().find(outpoints[i]);
+        BOOST_CHECK(it != cache.map().end());
+        BOOST_CHECK_EQUAL(it->second.flags & ~CCoinsCacheEntry::USED, i == 1 ? CCoinsCacheEntry::DIRTY : 0);
+    }
+    cache.SelfTest();
+
+    // Trimming evicts coins not used lately first, and never modified ones
+    for (size_t i = 500; i < outpoints.size(); i++)
+        cache.AccessCoin(outpoints[i]);
+    size_t nTargetUsage = cache.DynamicMemoryUsage() / 3;
+    cache.Trim(nTargetUsage);
+    cache.SelfTest();
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= nTargetUsage);
+    BOOST_CHECK(cache.map().count(outpoints[1]));
+    for (size_t i = 2; i < 500; i++)
+        BOOST_CHECK(!cache.HaveCoinInCache(outpoints[i]));
+    size_t nKept = 0;
+    for (size_t i = 500; i < outpoints.size(); i++)
+        nKept += cache.HaveCoinInCache(outpoints[i]);
+    BOOST_CHECK(nKept > 0);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1 + nKept);
+
+    // Down to nothing, only the modified coin is left
+    cache.Trim(0);
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+    BOOST_CHECK(cache.map().count(outpoints[1]));
+    BOOST_CHECK(cache.Sync());
+    cache.Trim(0);
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    Coin coin;
+    BOOST_CHECK(!base.GetCoin(outpoints[1], coin) || coin.IsSpent());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
 #include <crypto/sha512.h>
+#include <crypto/yespower.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
 #include <random.h>
@@ -200,6 +201,24 @@ void TestChaCha20(const std::string &hexkey, uint64_t nonce, uint64_t seek, cons
     BOOST_CHECK(out == outres);
 }
 
+void TestYespower(yespower_version_t version, uint32_t N, uint32_t r, const char* pers, const std::string& hexout)
+{
+    yespower_params_t params = {version, N, r, (const uint8_t*)pers, pers ? strlen(pers) : 0};
+    std::vector<unsigned char> in(80);
+    for (size_t i = 0; i < in.size(); i++) in[i] = i * 3;
+    std::vector<unsigned char> out = ParseHex(hexout);
+    yespower_binary_t hash;
+    // Thread-local scratch space.
+    BOOST_CHECK(yespower_tls(in.data(), in.size(), &params, &hash) == 0);
+    BOOST_CHECK(std::vector<unsigned char>(hash.uc, hash.uc + sizeof(hash.uc)) == out);
+    // Caller-owned scratch space.
+    yespower_local_t local;
+    BOOST_CHECK(yespower_init_local(&local) == 0);
+    BOOST_CHECK(yespower(&local, in.data(), in.size(), &params, &hash) == 0);
+    BOOST_CHECK(std::vector<unsigned char>(hash.uc, hash.uc + sizeof(hash.uc)) == out);
+    BOOST_CHECK(yespower_free_local(&local) == 0);
+}
+
 std::string LongTestString(void) {
     std::string ret;
     for (int i=0; i<200000; i++) {
@@ -524,6 +543,18 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+BOOST_AUTO_TEST_CASE(yespower_testvectors) {
+    // Test vectors from crypto/yespower-1.0.1/TESTS-OK, run against the kernel picked by YespowerAutoDetect().
+    TestYespower(YESPOWER_0_5, 2048, 8, "Client Key",
+                 "a59fec4c4fdda16e3b1405adda66d525b68e7cadfcfe6ac066c7ad118cd80590");
+    TestYespower(YESPOWER_1_0, 2048, 8, nullptr,
+                 "69e0e895b3df7aeeb837d71fe199e9d34f7ec46ecbca7a2c4308e51857ae9b46");
+    TestYespower(YESPOWER_1_0, 2048, 32, nullptr,
+                 "d5efb813cd263e9b34540130233cbbc6a921fbff3431e5ec1a1abde2aea6ff4d");
+    TestYespower(YESPOWER_1_0, 1024, 32, "personality test",
+                 "1f0269acf565c49adc0ef9b8f26ab3808cdc38394a254fddeedcc3aacff6ad9d");
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
@@ -187,4 +187,73 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(cnode_receive_payload_direct)
+{
+    // A 300KB block message, of which everything but the last 16KB can be
+    // received straight into the message buffer.
+    std::vector<unsigned char> payload(300 * 1000);
+    for (size_t i = 0; i < payload.size(); i++)
+        payload[i] = i * 7;
+    uint256 hash = Hash(payload.begin(), payload.end());
+    CMessageHeader hdr(Params().MessageStart(), NetMsgType::BLOCK, payload.size());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    std::vector<unsigned char> wire;
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, wire, 0, hdr};
+    wire.insert(wire.end(), payload.begin(), payload.end());
+
+    // CNetMessage on its own: header plus the first bytes copied, the rest written into GetDataBuffer().
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    BOOST_CHECK_EQUAL(msg.readHeader((const char*)wire.data(), 10), 10);
+    const int nHeaderSize = CMessageHeader::HEADER_SIZE;
+    BOOST_CHECK_EQUAL(msg.readHeader((const char*)wire.data() + 10, 1000), nHeaderSize - 10);
+    BOOST_CHECK(msg.in_data);
+    BOOST_CHECK_EQUAL(msg.hdr.GetCommand(), NetMsgType::BLOCK);
+    BOOST_CHECK_EQUAL(msg.hdr.nMessageSize, payload.size());
+    size_t nPos = CMessageHeader::HEADER_SIZE;
+    nPos += msg.readData((const char*)wire.data() + nPos, 1000);
+    while (!msg.complete()) {
+        unsigned int nBytes = 100 * 1000;
+        char* pch = msg.GetDataBuffer(nBytes);
+        BOOST_CHECK(nBytes > 0 && nBytes <= 100 * 1000);
+        memcpy(pch, wire.data() + nPos, nBytes);
+        msg.DataReceived(nBytes);
+        nPos += nBytes;
+    }
+    BOOST_CHECK_EQUAL(nPos, wire.size());
+    BOOST_CHECK(msg.GetMessageHash() == hash);
+    BOOST_CHECK(memcmp(payload.data(), &msg.vRecv[0], payload.size()) == 0);
+
+    // The same through CNode, followed by a ping in the same read as the payload's tail.
+    CAddress addr(CService(CNetAddr(), 7777), NODE_NETWORK);
+    std::unique_ptr<CNode> pnode(new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", true));
+    unsigned int nBytes = 0;
+    bool complete = false;
+    BOOST_CHECK(pnode->GetRecvPayloadBuffer(nBytes) == nullptr);
+    BOOST_CHECK(pnode->ReceiveMsgBytes((const char*)wire.data(), 5000, complete));
+    BOOST_CHECK(!complete);
+    nPos = 5000;
+    char* pch;
+    while ((pch = pnode->GetRecvPayloadBuffer(nBytes))) {
+        BOOST_CHECK(nPos + nBytes <= wire.size());
+        memcpy(pch, wire.data() + nPos, nBytes);
+        pnode->ReceivedPayloadBytes(nBytes, complete);
+        BOOST_CHECK(!complete);
+        nPos += nBytes;
+    }
+    BOOST_CHECK(wire.size() - nPos < 0x10000);
+    std::vector<unsigned char> tail(wire.begin() + nPos, wire.end());
+    CMessageHeader hdrPing(Params().MessageStart(), NetMsgType::PING, 0);
+    uint256 hashEmpty = Hash(tail.end(), tail.end());
+    memcpy(hdrPing.pchChecksum, hashEmpty.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, tail, tail.size(), hdrPing};
+    BOOST_CHECK(pnode->ReceiveMsgBytes((const char*)tail.data(), tail.size(), complete));
+    BOOST_CHECK(complete);
+
+    CNodeStats stats;
+    pnode->copyStats(stats);
+    BOOST_CHECK_EQUAL(stats.nRecvBytes, wire.size() + nHeaderSize);
+    BOOST_CHECK_EQUAL(stats.mapRecvBytesPerMsgCmd[NetMsgType::BLOCK], wire.size());
+    BOOST_CHECK_EQUAL(stats.mapRecvBytesPerMsgCmd[NetMsgType::PING], nHeaderSize);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
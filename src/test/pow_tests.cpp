@@ -2,6 +2,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <arith_uint256.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <pow.h>
@@ -146,4 +147,50 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+/* The rolling averaging window must agree with the full walk, across forks too */
+BOOST_AUTO_TEST_CASE(averaging_window_cache)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    const int nBlocks = 2000;
+    const int nForkHeight = 1500;
+
+    // Main chain plus a fork branching off at nForkHeight, both with random targets.
+    std::vector<CBlockIndex> blocks(nBlocks);
+    std::vector<CBlockIndex> fork(nBlocks - nForkHeight);
+    std::vector<uint256> hashes(blocks.size() + fork.size());
+    for (uint256& hash : hashes) hash = InsecureRand256();
+    for (int i = 0; i < nBlocks; i++) {
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        blocks[i].nBits = 0x1f000000 | (InsecureRandBits(22) + 1);
+        blocks[i].phashBlock = &hashes[i];
+        blocks[i].BuildSkip();
+    }
+    for (size_t i = 0; i < fork.size(); i++) {
+        fork[i].pprev = i ? &fork[i - 1] : &blocks[nForkHeight - 1];
+        fork[i].nHeight = nForkHeight + i;
+        fork[i].nBits = 0x1e000000 | (InsecureRandBits(22) + 1);
+        fork[i].phashBlock = &hashes[nBlocks + i];
+        fork[i].BuildSkip();
+    }
+
+    arith_uint256 bnCached, bnFull;
+    BOOST_CHECK(!GetAveragingWindowSumCached(&blocks[params.nPowAveragingWindow - 1], params, bnCached));
+    BOOST_CHECK(!GetAveragingWindowSum(&blocks[params.nPowAveragingWindow - 1], params, bnFull));
+
+    // Follow the main chain, then alternate between the two branches.
+    for (int i = params.nPowAveragingWindow; i < nBlocks; i++) {
+        BOOST_CHECK(GetAveragingWindowSumCached(&blocks[i], params, bnCached));
+        BOOST_CHECK(GetAveragingWindowSum(&blocks[i], params, bnFull));
+        BOOST_CHECK(bnCached == bnFull);
+    }
+    for (size_t i = 0; i < fork.size(); i++) {
+        for (const CBlockIndex* pindex : {&fork[i], &blocks[nForkHeight + i], &blocks[InsecureRandRange(nBlocks)]}) {
+            BOOST_CHECK_EQUAL(GetAveragingWindowSumCached(pindex, params, bnCached), GetAveragingWindowSum(pindex, params, bnFull));
+            BOOST_CHECK(bnCached == bnFull);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
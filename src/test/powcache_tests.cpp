@@ -0,0 +1,166 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <pow.h>
+#include <txdb.h>
+#include <validation.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(powcache_tests, TestingSetup)
+
+//! A header with random fields and the given nBits
+static CBlockHeaderUncached RandomHeader(uint32_t nBits)
+{
+    CBlockHeaderUncached header;
+    header.nVersion = 0x20000000;
+    header.hashPrevBlock = InsecureRand256();
+    header.hashMerkleRoot = InsecureRand256();
+    header.nTime = 1565913602 + InsecureRandRange(1000000);
+    header.nBits = nBits;
+    header.nNonce = InsecureRand32();
+    return header;
+}
+
+//! Grind the nonce until header passes the proof of work check at the network's easiest target
+static void Mine(CBlockHeaderUncached& header)
+{
+    header.nBits = UintToArith256(Params().GetConsensus().powLimit).GetCompact();
+    while (!CheckProofOfWork(header.GetPoWHash(), header.nBits, Params().GetConsensus()))
+        ++header.nNonce;
+}
+
+//! GetBlockPoWHash() of a copy of header that has no PoW hash cached in memory yet
+static uint256 PoWHashOf(const CBlockHeaderUncached& header)
+{
+    CBlockHeader block;
+    static_cast<CBlockHeaderUncached&>(block) = header;
+    return GetBlockPoWHash(block);
+}
+
+BOOST_AUTO_TEST_CASE(powcache_readwrite)
+{
+    CPoWHashDB db(1 << 20, true);
+    uint256 hash = InsecureRand256();
+    uint256 powHash = InsecureRand256();
+    uint256 powHashRead;
+    BOOST_CHECK(!db.ReadPoWHash(hash, powHashRead));
+    BOOST_CHECK(db.WritePoWHash(hash, powHash));
+    BOOST_CHECK(db.ReadPoWHash(hash, powHashRead));
+    BOOST_CHECK(powHashRead == powHash);
+    BOOST_CHECK(!db.ReadPoWHash(InsecureRand256(), powHashRead));
+}
+
+BOOST_AUTO_TEST_CASE(powcache_getblockpowhash)
+{
+    uint64_t nHits, nMisses, nHitsBefore, nMissesBefore;
+    size_t nSizeOnDisk;
+
+    // Without -powcache, nothing is looked up or counted
+    BOOST_REQUIRE(!ppowhashdb);
+    BOOST_CHECK(!GetPoWCacheStats(nHitsBefore, nMissesBefore, nSizeOnDisk));
+    BOOST_CHECK_EQUAL(nSizeOnDisk, 0U);
+    // Far below the limit, so this one fails its check
+    const CBlockHeaderUncached failing = RandomHeader(0x1d00ffff);
+    const uint256 powHashFailing = failing.GetPoWHash();
+    BOOST_CHECK(!CheckProofOfWork(powHashFailing, failing.nBits, Params().GetConsensus()));
+    BOOST_CHECK(PoWHashOf(failing) == powHashFailing);
+    GetPoWCacheStats(nHits, nMisses, nSizeOnDisk);
+    BOOST_CHECK_EQUAL(nHits, nHitsBefore);
+    BOOST_CHECK_EQUAL(nMisses, nMissesBefore);
+
+    ppowhashdb.reset(new CPoWHashDB(1 << 20, true));
+    BOOST_CHECK(GetPoWCacheStats(nHitsBefore, nMissesBefore, nSizeOnDisk));
+
+    // A hash that fails its check is computed, counted as a miss and not kept
+    BOOST_CHECK(PoWHashOf(failing) == powHashFailing);
+    uint256 powHashRead;
+    BOOST_CHECK(!ppowhashdb->ReadPoWHash(failing.GetHash(), powHashRead));
+    BOOST_CHECK(PoWHashOf(failing) == powHashFailing);
+    GetPoWCacheStats(nHits, nMisses, nSizeOnDisk);
+    BOOST_CHECK_EQUAL(nHits, nHitsBefore);
+    BOOST_CHECK_EQUAL(nMisses, nMissesBefore + 2);
+
+    // A hash that passes is kept
+    CBlockHeaderUncached mined = RandomHeader(0);
+    Mine(mined);
+    const uint256 powHashMined = mined.GetPoWHash();
+    BOOST_CHECK(PoWHashOf(mined) == powHashMined);
+    BOOST_CHECK(ppowhashdb->ReadPoWHash(mined.GetHash(), powHashRead));
+    BOOST_CHECK(powHashRead == powHashMined);
+    GetPoWCacheStats(nHits, nMisses, nSizeOnDisk);
+    BOOST_CHECK_EQUAL(nMisses, nMissesBefore + 3);
+
+    // A hash found on disk is used without computing yespower
+    BOOST_CHECK(ppowhashdb->WritePoWHash(failing.GetHash(), powHashFailing));
+    BOOST_CHECK(PoWHashOf(failing) == powHashFailing);
+    GetPoWCacheStats(nHits, nMisses, nSizeOnDisk);
+    BOOST_CHECK_EQUAL(nHits, nHitsBefore + 1);
+    BOOST_CHECK_EQUAL(nMisses, nMissesBefore + 3);
+
+    // With and without the cache, the same header hashes the same
+    for (int i = 0; i < 8; i++) {
+        const CBlockHeaderUncached header = RandomHeader(0x1d00ffff);
+        const uint256 powHashWith = PoWHashOf(header);
+        BOOST_CHECK(ppowhashdb->WritePoWHash(header.GetHash(), powHashWith));
+        const uint256 powHashCached = PoWHashOf(header);
+        std::unique_ptr<CPoWHashDB> db = std::move(ppowhashdb);
+        const uint256 powHashWithout = PoWHashOf(header);
+        ppowhashdb = std::move(db);
+        BOOST_CHECK(powHashWith == header.GetPoWHash());
+        BOOST_CHECK(powHashCached == powHashWith);
+        BOOST_CHECK(powHashWithout == powHashWith);
+    }
+
+    ppowhashdb.reset();
+}
+
+BOOST_AUTO_TEST_CASE(powcache_loadblockindex)
+{
+    // One block index record of a header whose PoW passes. It has no parent,
+    // as the record is hashed with the parent's hash it was written with.
+    CBlockTreeDB blocktree(1 << 20, true);
+    CBlockHeaderUncached mined = RandomHeader(0);
+    mined.hashPrevBlock.SetNull();
+    Mine(mined);
+    CBlockHeader block;
+    static_cast<CBlockHeaderUncached&>(block) = mined;
+    const uint256 hash = block.GetHash();
+    CBlockIndex index(block);
+    index.phashBlock = &hash;
+    index.nStatus = BLOCK_VALID_TREE;
+    BOOST_REQUIRE(blocktree.WriteBatchSync({}, 0, {&index}));
+
+    auto load = [&](const CPoWHashDB* powhashdb) {
+        BlockMap map;
+        CBlockIndexArena arena;
+        auto insertBlockIndex = [&](const uint256& hashIn) -> CBlockIndex* {
+            if (hashIn.IsNull()) return nullptr;
+            BlockMap::iterator mi = map.find(hashIn);
+            if (mi != map.end()) return mi->second;
+            CBlockIndex* pindexNew = arena.Allocate();
+            mi = map.insert(std::make_pair(hashIn, pindexNew)).first;
+            pindexNew->phashBlock = &mi->first;
+            return pindexNew;
+        };
+        return blocktree.LoadBlockIndexGuts(Params().GetConsensus(), insertBlockIndex, powhashdb);
+    };
+
+    // Headers aren't hashed at startup; only a recorded PoW hash is checked
+    CPoWHashDB powhashdb(1 << 20, true);
+    BOOST_CHECK(load(nullptr));
+    BOOST_CHECK(load(&powhashdb));
+    BOOST_CHECK(powhashdb.WritePoWHash(hash, mined.GetPoWHash()));
+    BOOST_CHECK(load(&powhashdb));
+
+    // A recorded hash that doesn't meet the header's target stops the load
+    BOOST_CHECK(powhashdb.WritePoWHash(hash, ArithToUint256(~arith_uint256())));
+    BOOST_CHECK(!load(&powhashdb));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,98 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <prefetchqueue.h>
+#include <test/test_bitcoin.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(prefetchqueue_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(prefetchqueue_order)
+{
+    for (int nThreads : {0, 1, 4}) {
+        CPrefetchPool pool;
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CPrefetchPool::Thread, &pool));
+        {
+            CPrefetchQueue<int> queue(nThreads ? &pool : nullptr);
+            for (int i = 0; i < 100; i++) {
+                queue.Push([i] {
+                    // Finish out of order
+                    std::this_thread::sleep_for(std::chrono::microseconds((100 - i) % 7 * 100));
+                    return i;
+                });
+            }
+            BOOST_CHECK_EQUAL(queue.size(), 100U);
+            for (int i = 0; i < 100; i++)
+                BOOST_CHECK_EQUAL(queue.Pop(), i);
+            BOOST_CHECK(queue.empty());
+        }
+        threads.interrupt_all();
+        threads.join_all();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(prefetchqueue_clear)
+{
+    std::atomic<int> nRun{0};
+    CPrefetchPool pool;
+    boost::thread_group threads;
+    for (int i = 0; i < 2; i++)
+        threads.create_thread(boost::bind(&CPrefetchPool::Thread, &pool));
+    {
+        CPrefetchQueue<int> queue(&pool);
+        for (int i = 0; i < 50; i++) {
+            queue.Push([i, &nRun] {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                nRun++;
+                return i;
+            });
+        }
+        BOOST_CHECK_EQUAL(queue.Pop(), 0);
+        queue.Clear();
+        BOOST_CHECK(queue.empty());
+        // Results of dropped jobs never come back
+        queue.Push([] { return 1000; });
+        queue.Push([] { return 1001; });
+        BOOST_CHECK_EQUAL(queue.Pop(), 1000);
+        BOOST_CHECK_EQUAL(queue.Pop(), 1001);
+    }
+    threads.interrupt_all();
+    threads.join_all();
+    BOOST_CHECK(nRun < 50);
+}
+
+BOOST_AUTO_TEST_CASE(prefetchqueue_shared_pool)
+{
+    // Two queues on the same threads, one of them dropped with jobs pending
+    CPrefetchPool pool;
+    boost::thread_group threads;
+    for (int i = 0; i < 3; i++)
+        threads.create_thread(boost::bind(&CPrefetchPool::Thread, &pool));
+    CPrefetchQueue<int> queue(&pool);
+    {
+        CPrefetchQueue<int> queueDropped(&pool);
+        for (int i = 0; i < 20; i++) {
+            queueDropped.Push([i] {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                return -i;
+            });
+            queue.Push([i] { return i; });
+        }
+    }
+    for (int i = 0; i < 20; i++)
+        BOOST_CHECK_EQUAL(queue.Pop(), i);
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,7 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chain.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <script/script.h>
 #include <util.h>
+#include <utiltime.h>
+#include <validation.h>
 #include <test/test_bitcoin.h>
 
 #include <vector>
@@ -177,4 +182,109 @@ BOOST_AUTO_TEST_CASE(findearliestatleast_edge_test)
     BOOST_CHECK(!chain.FindEarliestAtLeast(int64_t(std::numeric_limits<unsigned int>::max()) + 1));
 }
 
+BOOST_AUTO_TEST_CASE(blockindex_arena_test)
+{
+    CBlockIndexArena arena;
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+    BOOST_CHECK_EQUAL(arena.DynamicMemoryUsage(), 0U);
+
+    // Span several chunks and make sure entries stay put and start out null.
+    std::vector<CBlockIndex*> entries;
+    for (int i = 0; i < 10000; i++) {
+        CBlockIndex* pindex = arena.Allocate();
+        BOOST_CHECK(pindex->phashBlock == nullptr && pindex->nHeight == 0 && pindex->nStatus == 0);
+        pindex->nHeight = i;
+        pindex->pprev = entries.empty() ? nullptr : entries.back();
+        entries.push_back(pindex);
+    }
+    BOOST_CHECK_EQUAL(arena.Size(), entries.size());
+    BOOST_CHECK(arena.DynamicMemoryUsage() >= entries.size() * sizeof(CBlockIndex));
+    for (int i = 0; i < 10000; i++) {
+        BOOST_CHECK_EQUAL(entries[i]->nHeight, i);
+        BOOST_CHECK(entries[i]->pprev == (i ? entries[i - 1] : nullptr));
+    }
+
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+    BOOST_CHECK_EQUAL(arena.DynamicMemoryUsage(), 0U);
+}
+
+//! Check that every cached median time past matches a fresh computation
+static void CheckMedianTimePast(const CBlockIndex* pindex)
+{
+    BOOST_CHECK(pindex->nTimeMedian != 0);
+    BOOST_CHECK_EQUAL(pindex->GetMedianTimePast(), pindex->ComputeMedianTimePast());
+}
+
+BOOST_AUTO_TEST_CASE(mediantimepast_cache_test)
+{
+    // A main chain and a branch off it, with timestamps that go back and forth
+    std::vector<CBlockIndex> vMain(1000);
+    std::vector<CBlockIndex> vBranch(600);
+    auto build = [](std::vector<CBlockIndex>& vBlocks, CBlockIndex* pprev) {
+        for (unsigned int i = 0; i < vBlocks.size(); i++) {
+            CBlockIndex& block = vBlocks[i];
+            block.pprev = i ? &vBlocks[i - 1] : pprev;
+            block.nHeight = block.pprev ? block.pprev->nHeight + 1 : 0;
+            block.nTime = 1565913602 + block.nHeight * 5 + InsecureRandRange(120);
+            block.BuildSkip();
+            block.BuildMedianTimePast();
+        }
+    };
+    build(vMain, nullptr);
+    build(vBranch, &vMain[499]);
+
+    CChain chain;
+    chain.SetTip(&vMain.back());
+    for (int h = 0; h <= chain.Height(); h++)
+        CheckMedianTimePast(chain[h]);
+
+    // Switching to the branch leaves every height with the right value
+    chain.SetTip(&vBranch.back());
+    BOOST_CHECK_EQUAL(chain.Height(), 1099);
+    for (int h = 0; h <= chain.Height(); h++)
+        CheckMedianTimePast(chain[h]);
+}
+
+BOOST_FIXTURE_TEST_CASE(mediantimepast_cache_validation_test, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    auto checkAll = [] {
+        LOCK(cs_main);
+        for (const auto& entry : mapBlockIndex)
+            CheckMedianTimePast(entry.second);
+        for (int h = 0; h <= chainActive.Height(); h++)
+            CheckMedianTimePast(chainActive[h]);
+    };
+    checkAll();
+
+    // Reorg the last 10 blocks away onto a longer branch mined later
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, chainparams, chainActive[chainActive.Height() - 9]));
+    }
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    SetMockTime(GetTime() + 3600);
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    for (int i = 0; i < 12; i++)
+        CreateAndProcessBlock({}, scriptPubKey);
+    BOOST_CHECK_EQUAL(chainActive.Height(), 102);
+    checkAll();
+
+    // Load the block index back from disk; the values are computed afresh
+    FlushStateToDisk();
+    UnloadBlockIndex();
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(mapBlockIndex.empty());
+        BOOST_CHECK(LoadBlockIndex(chainparams));
+        BOOST_CHECK(LoadChainTip(chainparams));
+        BOOST_CHECK_EQUAL(mapBlockIndex.size(), 113U);
+        BOOST_CHECK_EQUAL(chainActive.Height(), 102);
+    }
+    checkAll();
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -368,4 +368,100 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_parallel_script_checks, TestChain100Setup)
+{
+    // A transaction with enough inputs has its scripts checked on the
+    // script-checking threads when entering the mempool; check that both
+    // valid and invalid signatures are still told apart.
+    BOOST_CHECK(nScriptCheckThreads > 0);
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // Split the mature coinbase into outputs to spend together
+    const unsigned int nInputs = MIN_PARALLEL_MEMPOOL_INPUTS * 2;
+    CMutableTransaction split;
+    split.nVersion = 1;
+    split.vin.resize(1);
+    split.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    split.vin[0].prevout.n = 0;
+    split.vout.resize(nInputs);
+    for (CTxOut& txout : split.vout) {
+        txout.nValue = 11*CENT;
+        txout.scriptPubKey = scriptPubKey;
+    }
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, split, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    split.vin[0].scriptSig << vchSig;
+    CBlock block = CreateAndProcessBlock({split}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(nInputs);
+    for (unsigned int i = 0; i < nInputs; i++) {
+        spend.vin[i].prevout.hash = split.GetHash();
+        spend.vin[i].prevout.n = i;
+    }
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT * nInputs - 10*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<std::vector<unsigned char>> vSigs(nInputs);
+    for (unsigned int i = 0; i < nInputs; i++) {
+        hash = SignatureHash(scriptPubKey, spend, i, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vSigs[i]));
+        vSigs[i].push_back((unsigned char)SIGHASH_ALL);
+    }
+
+    // Swapping two inputs' signatures invalidates both
+    CMutableTransaction invalid = spend;
+    for (unsigned int i = 0; i < nInputs; i++)
+        invalid.vin[i].scriptSig = CScript() << vSigs[i == 3 ? 5 : i == 5 ? 3 : i];
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(!AcceptToMemoryPool(mempool, state, MakeTransactionRef(invalid), nullptr, nullptr, true, 0));
+        BOOST_CHECK_EQUAL(state.GetRejectReason().find("mandatory-script-verify-flag-failed"), 0U);
+        int nDoS;
+        BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 100);
+    }
+
+    // Only the last input fails, and gets the reject reason by itself
+    for (unsigned int i = 0; i < nInputs; i++)
+        invalid.vin[i].scriptSig = CScript() << vSigs[i == nInputs - 1 ? 0 : i];
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(!AcceptToMemoryPool(mempool, state, MakeTransactionRef(invalid), nullptr, nullptr, true, 0));
+        BOOST_CHECK_EQUAL(state.GetRejectReason().find("mandatory-script-verify-flag-failed"), 0U);
+        int nDoS;
+        BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 100);
+    }
+
+    // With a non-minimal push on input 3 and no signature at all on input 5,
+    // the lower input decides, as it does when checking them one by one,
+    // even when a thread that stole input 5 runs into it first
+    for (unsigned int i = 0; i < nInputs; i++)
+        invalid.vin[i].scriptSig = CScript() << vSigs[i];
+    invalid.vin[5].scriptSig = CScript();
+    invalid.vin[3].scriptSig = CScript() << OP_PUSHDATA1;
+    invalid.vin[3].scriptSig.push_back(vSigs[3].size());
+    invalid.vin[3].scriptSig.insert(invalid.vin[3].scriptSig.end(), vSigs[3].begin(), vSigs[3].end());
+    for (int n = 0; n < 20; n++) {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(!AcceptToMemoryPool(mempool, state, MakeTransactionRef(invalid), nullptr, nullptr, true, 0));
+        BOOST_CHECK_EQUAL(state.GetRejectReason().find("non-mandatory-script-verify-flag"), 0U);
+        int nDoS;
+        BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 0);
+    }
+
+    for (unsigned int i = 0; i < nInputs; i++)
+        spend.vin[i].scriptSig = CScript() << vSigs[i];
+    BOOST_CHECK(ToMemPool(spend));
+    BOOST_CHECK(mempool.exists(spend.GetHash()));
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
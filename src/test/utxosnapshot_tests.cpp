@@ -0,0 +1,124 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <clientversion.h>
+#include <coins.h>
+#include <script/script.h>
+#include <streams.h>
+#include <txdb.h>
+#include <utxosnapshot.h>
+#include <test/test_bitcoin.h>
+
+#include <stdio.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxosnapshot_tests, TestingSetup)
+
+//! Fill an in-memory coins database with a few transactions of several outputs each
+static void FillCoinsDB(CCoinsViewDB& db, const uint256& hashBlock)
+{
+    CCoinsViewCache cache(&db);
+    for (int i = 0; i < 50; i++) {
+        uint256 txid = InsecureRand256();
+        uint32_t nOutputs = 1 + InsecureRandRange(5);
+        for (uint32_t n = 0; n < nOutputs; n++) {
+            Coin coin;
+            coin.out.nValue = 1 + InsecureRandRange(1000000);
+            coin.out.scriptPubKey = CScript() << OP_TRUE << InsecureRandRange(100);
+            coin.nHeight = 1 + InsecureRandRange(100);
+            coin.fCoinBase = n == 0 && InsecureRandBool();
+            cache.AddCoin(COutPoint(txid, n * 2), std::move(coin), false);
+        }
+    }
+    cache.SetBestBlock(hashBlock);
+    BOOST_CHECK(cache.Flush());
+}
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_roundtrip)
+{
+    CCoinsViewDB db(1 << 20, true);
+    uint256 hashBlock = InsecureRand256();
+    FillCoinsDB(db, hashBlock);
+
+    // The snapshot commits to the same hash as a second walk over the set
+    CUTXOSetHasher hasher(hashBlock);
+    uint64_t nCoins = 0;
+    std::unique_ptr<CCoinsViewCursor> pcursor(db.Cursor());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_CHECK(pcursor->GetKey(outpoint) && pcursor->GetValue(coin));
+        hasher.Add(outpoint, std::move(coin));
+        nCoins++;
+    }
+    uint256 hashSet = hasher.GetHash();
+    BOOST_CHECK_EQUAL(hasher.nTransactions, 50U);
+    BOOST_CHECK_EQUAL(hasher.nTransactionOutputs, nCoins);
+
+    CUTXOSnapshotHeader header;
+    header.hashBlock = hashBlock;
+    header.nHeight = 100;
+    header.nTx = 3;
+    header.nChainTx = 250;
+    fs::path path = pathTemp / "utxo.dat";
+    pcursor.reset(db.Cursor());
+    BOOST_CHECK(WriteUTXOSnapshot(pcursor.get(), header, path));
+    BOOST_CHECK(!fs::exists(path.string() + ".incomplete"));
+    BOOST_CHECK_EQUAL(header.nCoins, nCoins);
+    BOOST_CHECK(header.hashSerialized == hashSet);
+
+    // Reading the file back gives the header and the coins in the same order
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    CUTXOSnapshotHeader headerRead;
+    file >> headerRead;
+    BOOST_CHECK(headerRead.hashBlock == hashBlock);
+    BOOST_CHECK_EQUAL(headerRead.nHeight, 100);
+    BOOST_CHECK_EQUAL(headerRead.nTx, 3U);
+    BOOST_CHECK_EQUAL(headerRead.nChainTx, 250U);
+    BOOST_CHECK_EQUAL(headerRead.nCoins, nCoins);
+    BOOST_CHECK(headerRead.hashSerialized == hashSet);
+    CUTXOSetHasher hasherRead(headerRead.hashBlock);
+    for (uint64_t i = 0; i < headerRead.nCoins; i++) {
+        COutPoint outpoint;
+        Coin coin;
+        file >> outpoint >> coin;
+        hasherRead.Add(outpoint, std::move(coin));
+    }
+    BOOST_CHECK(fgetc(file.Get()) == EOF);
+    BOOST_CHECK(hasherRead.GetHash() == hashSet);
+}
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_header)
+{
+    CUTXOSnapshotHeader header;
+    header.hashBlock = InsecureRand256();
+    header.nHeight = 100;
+    header.nTx = 3;
+    header.nChainTx = 250;
+    header.nCoins = 7;
+    header.hashSerialized = InsecureRand256();
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << header;
+    CUTXOSnapshotHeader headerRead;
+    ss >> headerRead;
+    BOOST_CHECK(headerRead.hashBlock == header.hashBlock);
+    BOOST_CHECK(headerRead.hashSerialized == header.hashSerialized);
+    BOOST_CHECK_EQUAL(headerRead.nCoins, 7U);
+
+    // Not a snapshot at all
+    ss.clear();
+    ss << std::string("not a snapshot");
+    BOOST_CHECK_THROW(ss >> headerRead, std::ios_base::failure);
+
+    // A version this node doesn't know
+    ss.clear();
+    header.nVersion = CUTXOSnapshotHeader::CURRENT_VERSION + 1;
+    ss << header;
+    BOOST_CHECK_THROW(ss >> headerRead, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
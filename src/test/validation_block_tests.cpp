@@ -4,12 +4,14 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <blockfilemap.h>
 #include <chainparams.h>
 #include <consensus/merkle.h>
 #include <consensus/validation.h>
 #include <miner.h>
 #include <pow.h>
 #include <random.h>
+#include <streams.h>
 #include <test/test_bitcoin.h>
 #include <validation.h>
 #include <validationinterface.h>
@@ -181,4 +183,49 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
     BOOST_CHECK_EQUAL(sub.m_expected_tip, chainActive.Tip()->GetBlockHash());
 }
 
+BOOST_FIXTURE_TEST_CASE(read_raw_block_from_disk, TestChain100Setup)
+{
+    const CBlockIndex* pindex;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+        pos = pindex->GetBlockPos();
+    }
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    std::vector<unsigned char> expected;
+    CVectorWriter{SER_NETWORK, PROTOCOL_VERSION, expected, 0, block};
+
+    std::vector<unsigned char> raw;
+    BOOST_CHECK(ReadRawBlockFromDisk(raw, pindex, Params().MessageStart()));
+    BOOST_CHECK(raw == expected);
+
+    // A stale position or a different hash is refused rather than served
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, pos, pindex->pprev->GetBlockHash(), Params().MessageStart()));
+    CDiskBlockPos posShifted(pos.nFile, pos.nPos + 1);
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, posShifted, pindex->GetBlockHash(), Params().MessageStart()));
+}
+
+BOOST_FIXTURE_TEST_CASE(read_block_from_mapped_file, TestChain100Setup)
+{
+    // Map the block file, then append a block to it and read that back
+    CBlock tip;
+    BOOST_CHECK(ReadBlockFromDisk(tip, chainActive.Tip(), Params().GetConsensus()));
+    CBlock appended = CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    const CBlockIndex* pindex = chainActive.Tip();
+    BOOST_CHECK_EQUAL(pindex->GetBlockHash(), appended.GetHash());
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    BOOST_CHECK_EQUAL(block.GetHash(), appended.GetHash());
+
+    // Mapped and stdio reads return the same bytes
+    std::vector<unsigned char> mapped, unmapped;
+    BOOST_CHECK(ReadRawBlockFromDisk(mapped, pindex, Params().MessageStart()));
+    blockFileMap.SetMaxFiles(0);
+    BOOST_CHECK(ReadRawBlockFromDisk(unmapped, pindex, Params().MessageStart()));
+    blockFileMap.SetMaxFiles(DEFAULT_MMAP_BLOCK_FILES);
+    BOOST_CHECK(mapped == unmapped);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include <txdb.h>
 
 #include <chainparams.h>
+#include <checkqueue.h>
 #include <hash.h>
 #include <random.h>
 #include <pow.h>
@@ -16,6 +17,9 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <thread>
+
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
@@ -30,6 +34,8 @@ static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
+static const char DB_POW_HASH = 'p';
+
 namespace {
 
 struct CoinEntry {
@@ -54,19 +60,83 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, bool fBackgroundWritesIn) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true), fBackgroundWrites(fBackgroundWritesIn)
+{
+    if (fBackgroundWrites) {
+        threadWriter = std::thread([this] {
+            RenameThread("sugarchain-coinsflush");
+            ThreadWriter();
+        });
+    }
+}
+
+CCoinsViewDB::~CCoinsViewDB()
 {
+    if (threadWriter.joinable()) {
+        // An unfinished write is left for ReplayBlocks to roll forward
+        if (!Sync())
+            LogPrintf("%s: the last background write to the coin database failed\n", __func__);
+        {
+            std::lock_guard<std::mutex> lock(csWriter);
+            fStopWriter = true;
+        }
+        condWriter.notify_all();
+        threadWriter.join();
+    }
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    if (fBackgroundWrites) {
+        // Entries leave mapWriting only once committed, so a miss here can be
+        // read from the database whether or not its batch was written yet.
+        std::lock_guard<std::mutex> lock(csWriter);
+        auto it = mapWriting.find(outpoint);
+        if (it != mapWriting.end()) {
+            coin = it->second;
+            return !coin.IsSpent();
+        }
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
+void CCoinsViewDB::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins, CCheckQueue<CCoinsFetch>* pqueue) const {
+    coins.resize(outpoints.size());
+    // LevelDB point reads are thread-safe, so a batch that would otherwise
+    // miss serially is handed to the workers. Small ones aren't worth it.
+    if (pqueue && outpoints.size() >= MIN_COINS_PER_FETCH_THREAD) {
+        std::vector<CCoinsFetch> vChecks;
+        vChecks.reserve(outpoints.size());
+        for (size_t i = 0; i < outpoints.size(); i++)
+            vChecks.emplace_back(this, &outpoints[i], &coins[i]);
+        CCheckQueueControl<CCoinsFetch> control(pqueue);
+        control.Add(vChecks);
+        if (control.Wait())
+            return;
+        // A read failed on a worker; read again here so the error is thrown to the caller
+    }
+    CCoinsView::GetCoins(outpoints, coins, nullptr);
+}
+
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    if (fBackgroundWrites) {
+        std::lock_guard<std::mutex> lock(csWriter);
+        auto it = mapWriting.find(outpoint);
+        if (it != mapWriting.end())
+            return !it->second.IsSpent();
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    if (fBackgroundWrites) {
+        std::lock_guard<std::mutex> lock(csWriter);
+        if (!hashWriting.IsNull())
+            return hashWriting;
+    }
+    return ReadBestBlock();
+}
+
+uint256 CCoinsViewDB::ReadBestBlock() const {
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
@@ -81,15 +151,10 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
-    CDBBatch batch(db);
-    size_t count = 0;
-    size_t changed = 0;
-    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
-    int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
+void CCoinsViewDB::BeginWrite(CDBBatch& batch, const uint256& hashBlock) {
     assert(!hashBlock.IsNull());
 
-    uint256 old_tip = GetBestBlock();
+    uint256 old_tip = ReadBestBlock();
     if (old_tip.IsNull()) {
         // We may be in the middle of replaying.
         std::vector<uint256> old_heads = GetHeadBlocks();
@@ -105,6 +170,63 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     // interrupting after partial writes from multiple independent reorgs.
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
+}
+
+void CCoinsViewDB::WritePartialBatch(CDBBatch& batch) {
+    LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+    db.WriteBatch(batch);
+    batch.Clear();
+    int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
+    if (crash_simulate) {
+        static FastRandomContext rng;
+        if (rng.randrange(crash_simulate) == 0) {
+            LogPrintf("Simulating a crash. Goodbye.\n");
+            _Exit(0);
+        }
+    }
+}
+
+bool CCoinsViewDB::EndWrite(CDBBatch& batch, const uint256& hashBlock, size_t changed, size_t count) {
+    // In the last batch, mark the database as consistent with hashBlock again.
+    batch.Erase(DB_HEAD_BLOCKS);
+    batch.Write(DB_BEST_BLOCK, hashBlock);
+
+    LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+    bool ret = db.WriteBatch(batch);
+    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    return ret;
+}
+
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) {
+    if (fBackgroundWrites) {
+        // One batch is written at a time; if the last one failed, so does this
+        if (!Sync())
+            return false;
+        std::lock_guard<std::mutex> lock(csWriter);
+        assert(mapWriting.empty());
+        nWritingTotal = mapCoins.size();
+        // The writer needs the coins as they are now, so those the caller
+        // keeps cached are copied; the rest are moved.
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
+            if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                nWritingUsage += it->second.coin.DynamicMemoryUsage();
+                if (erase)
+                    mapWriting.emplace(it->first, std::move(it->second.coin));
+                else
+                    mapWriting.emplace(it->first, it->second.coin);
+            }
+        }
+        hashWriting = hashBlock;
+        fWriting = true;
+        condWriter.notify_all();
+        return true;
+    }
+
+    CDBBatch batch(db);
+    size_t count = 0;
+    size_t changed = 0;
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    BeginWrite(batch, hashBlock);
 
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -116,30 +238,93 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (erase)
+            it = mapCoins.erase(it);
+        else
+            ++it;
+        if (batch.SizeEstimate() > batch_size)
+            WritePartialBatch(batch);
+    }
+
+    return EndWrite(batch, hashBlock, changed, count);
+}
+
+bool CCoinsViewDB::WriteBehind() {
+    // Nothing else modifies mapWriting while a write is in progress, so it is
+    // iterated unlocked; the lock is only taken to erase what was committed.
+    CDBBatch batch(db);
+    size_t changed = mapWriting.size();
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    BeginWrite(batch, hashWriting);
+
+    auto itCommitted = mapWriting.begin();
+    for (auto it = mapWriting.begin(); it != mapWriting.end();) {
+        CoinEntry entry(&it->first);
+        if (it->second.IsSpent())
+            batch.Erase(entry);
+        else
+            batch.Write(entry, it->second);
+        ++it;
         if (batch.SizeEstimate() > batch_size) {
-            LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
-            db.WriteBatch(batch);
-            batch.Clear();
-            if (crash_simulate) {
-                static FastRandomContext rng;
-                if (rng.randrange(crash_simulate) == 0) {
-                    LogPrintf("Simulating a crash. Goodbye.\n");
-                    _Exit(0);
-                }
-            }
+            WritePartialBatch(batch);
+            std::lock_guard<std::mutex> lock(csWriter);
+            for (; itCommitted != it; itCommitted = mapWriting.erase(itCommitted))
+                nWritingUsage -= itCommitted->second.DynamicMemoryUsage();
         }
     }
 
-    // In the last batch, mark the database as consistent with hashBlock again.
-    batch.Erase(DB_HEAD_BLOCKS);
-    batch.Write(DB_BEST_BLOCK, hashBlock);
+    return EndWrite(batch, hashWriting, changed, nWritingTotal);
+}
 
-    LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
-    bool ret = db.WriteBatch(batch);
-    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return ret;
+void CCoinsViewDB::ThreadWriter() {
+    std::unique_lock<std::mutex> lock(csWriter);
+    while (true) {
+        condWriter.wait(lock, [this] { return fWriting || fStopWriter; });
+        if (!fWriting)
+            return;
+        lock.unlock();
+        bool fOk = false;
+        try {
+            fOk = WriteBehind();
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        lock.lock();
+        fWriting = false;
+        if (fOk) {
+            // Also shrink the bucket array, which erasing keeps
+            mapWriting.clear();
+            mapWriting.rehash(0);
+            nWritingUsage = 0;
+            hashWriting.SetNull();
+        } else {
+            // Keep serving reads from what is left; BatchWrite and Sync now fail
+            fWriteFailed = true;
+        }
+        condWriter.notify_all();
+    }
+}
+
+bool CCoinsViewDB::Sync() const {
+    if (!fBackgroundWrites)
+        return true;
+    std::unique_lock<std::mutex> lock(csWriter);
+    condWriter.wait(lock, [this] { return !fWriting; });
+    return !fWriteFailed;
+}
+
+bool CCoinsViewDB::IsWriting() const {
+    if (!fBackgroundWrites)
+        return false;
+    std::lock_guard<std::mutex> lock(csWriter);
+    return fWriting;
+}
+
+size_t CCoinsViewDB::WritingMemoryUsage() const {
+    if (!fBackgroundWrites)
+        return 0;
+    std::lock_guard<std::mutex> lock(csWriter);
+    return memusage::DynamicUsage(mapWriting) + nWritingUsage;
 }
 
 size_t CCoinsViewDB::EstimateSize() const
@@ -172,6 +357,10 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    // The cursor iterates the database itself, so it has to be up to date.
+    // After a failed background write it's half-written, under no best block.
+    if (!Sync())
+        return nullptr;
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
@@ -259,21 +448,157 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+size_t CBlockTreeDB::EstimateBlockIndexEntries() const
+{
+    // Typical size of one DB_BLOCK_INDEX record (key and CDiskBlockIndex) in an uncompressed table.
+    static const size_t nBytesPerEntry = 128;
+    return EstimateSize(DB_BLOCK_INDEX, (char)(DB_BLOCK_INDEX+1)) / nBytesPerEntry;
+}
+
+namespace {
+
+//! Number of block index records decoded per pipeline stage in LoadBlockIndexGuts
+static const size_t BLOCK_INDEX_LOAD_BATCH = 16384;
+
+/**
+ * Threads computing the block hashes of batches of decoded records, started
+ * once for the whole load. With -powcache, they also check the PoW of every
+ * header whose PoW hash was recorded.
+ */
+class CBlockIndexHasher
+{
+private:
+    const Consensus::Params& consensusParams;
+    const CPoWHashDB* powhashdb;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable condWorker;
+    std::condition_variable condDone;
+    //! Bumped for every batch handed to the workers
+    uint64_t nGeneration = 0;
+    int nPending = 0;
+    bool fQuit = false;
+
+    const std::vector<CDiskBlockIndex>* pvIndex = nullptr;
+    std::vector<uint256> vHashes;
+    //! First failing record found by each worker, or the batch size
+    std::vector<size_t> vBadPoW;
+
+    void Loop(int nWorker)
+    {
+        uint64_t nSeen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condWorker.wait(lock, [&] { return fQuit || nGeneration != nSeen; });
+                if (fQuit)
+                    return;
+                nSeen = nGeneration;
+            }
+            const std::vector<CDiskBlockIndex>& vIndex = *pvIndex;
+            const size_t nChunk = (vIndex.size() + threads.size() - 1) / threads.size();
+            const size_t nBegin = std::min(nWorker * nChunk, vIndex.size());
+            const size_t nEnd = std::min(nBegin + nChunk, vIndex.size());
+            for (size_t i = nBegin; i < nEnd; i++) {
+                vHashes[i] = vIndex[i].GetBlockHash();
+                // With -powcache, headers whose PoW hash was recorded can be checked
+                // with a lookup instead of recomputing yespower.
+                uint256 powHash;
+                if (powhashdb && powhashdb->ReadPoWHash(vHashes[i], powHash) &&
+                    !CheckProofOfWork(powHash, vIndex[i].nBits, consensusParams)) {
+                    vBadPoW[nWorker] = i;
+                    break;
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--nPending == 0)
+                condDone.notify_one();
+        }
+    }
+
+public:
+    CBlockIndexHasher(int nThreads, const Consensus::Params& consensusParamsIn, const CPoWHashDB* powhashdbIn)
+        : consensusParams(consensusParamsIn), powhashdb(powhashdbIn)
+    {
+        threads.reserve(nThreads);
+        for (int i = 0; i < nThreads; i++)
+            threads.emplace_back([this, i] { Loop(i); });
+    }
+
+    ~CBlockIndexHasher()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condDone.wait(lock, [this] { return nPending == 0; });
+            fQuit = true;
+        }
+        condWorker.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    /** Have the workers hash vIndex, which must stay untouched until Wait() returns */
+    void Start(const std::vector<CDiskBlockIndex>& vIndex)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pvIndex = &vIndex;
+        vHashes.resize(vIndex.size());
+        vBadPoW.assign(threads.size(), vIndex.size());
+        nPending = threads.size();
+        nGeneration++;
+        condWorker.notify_all();
+    }
+
+    /** Wait for the batch passed to Start() and return the index of its first record failing PoW, or its size */
+    size_t Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condDone.wait(lock, [this] { return nPending == 0; });
+        return *std::min_element(vBadPoW.begin(), vBadPoW.end());
+    }
+
+    const uint256& GetHash(size_t i) const { return vHashes[i]; }
+};
+
+} // namespace
+
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, const CPoWHashDB* powhashdb)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
+    // Headers aren't hashed with yespower again here; that would take
+    // several minutes on every startup. With -powcache, the PoW hashes
+    // recorded when the headers were accepted are checked instead.
+
+    // Load mapBlockIndex as a three-stage pipeline: this thread decodes a batch
+    // of records from the cursor while the previous batch is hashed (and its
+    // cached PoW checked) by the hasher's threads, then inserts the hashed batch.
+    std::vector<CDiskBlockIndex> vBatch, vHashing;
+    CBlockIndexHasher hasher(std::max(1, GetNumCores()), consensusParams, powhashdb); // destroyed before vHashing
+    bool fHashing = false;
+    while (true) {
+        vBatch.clear();
+        while (vBatch.size() < BLOCK_INDEX_LOAD_BATCH) {
+            boost::this_thread::interruption_point();
+            std::pair<char, uint256> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX)
+                break;
+            vBatch.emplace_back();
+            if (!pcursor->GetValue(vBatch.back()))
+                return error("%s: failed to read value", __func__);
+            pcursor->Next();
+        }
+
+        if (fHashing) {
+            const size_t nBadPoW = hasher.Wait();
+            fHashing = false;
+            for (size_t i = 0; i < vHashing.size(); i++) {
+                const CDiskBlockIndex& diskindex = vHashing[i];
                 // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
+                CBlockIndex* pindexNew = insertBlockIndex(hasher.GetHash(i));
                 pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
                 pindexNew->nHeight        = diskindex.nHeight;
                 pindexNew->nFile          = diskindex.nFile;
@@ -287,29 +612,37 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
 
-                // FIXME.SUGAR // SURE?
-                // Litecoin: Disable PoW Sanity check while loading block index from disk.
-                // We use the sha256 hash for the block index for performance reasons, which is recorded for later use.
-                // CheckProofOfWork() uses the scrypt hash which is discarded after a block is accepted.
-                // While it is technically feasible to verify the PoW, doing so takes several minutes as it
-                // requires recomputing every PoW hash during every Litecoin startup.
-                // We opt instead to simply trust the data that is on your local disk.
-
-                //if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                //    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
+                if (i == nBadPoW)
+                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
             }
-        } else {
-            break;
         }
+
+        if (vBatch.empty())
+            break;
+        std::swap(vBatch, vHashing);
+        hasher.Start(vHashing);
+        fHashing = true;
     }
 
     return true;
 }
 
+CPoWHashDB::CPoWHashDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "powcache", nCacheSize, fMemory, fWipe) {
+}
+
+bool CPoWHashDB::ReadPoWHash(const uint256 &hash, uint256 &powHash) const {
+    return Read(std::make_pair(DB_POW_HASH, hash), powHash);
+}
+
+bool CPoWHashDB::WritePoWHash(const uint256 &hash, const uint256 &powHash) {
+    return Write(std::make_pair(DB_POW_HASH, hash), powHash);
+}
+
+size_t CPoWHashDB::EstimateSize() const
+{
+    return CDBWrapper::EstimateSize(DB_POW_HASH, (char)(DB_POW_HASH+1));
+}
+
 namespace {
 
 //! Legacy class to deserialize pre-pertxout database entries without reindex.
@@ -10,14 +10,19 @@
 #include <dbwrapper.h>
 #include <chain.h>
 
+#include <condition_variable>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
+class CPoWHashDB;
 class uint256;
 
 //! No need to periodic flush if at least this much space still available.
@@ -38,6 +43,14 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Memory allocated to the PoW hash cache DB (MiB)
+static const int64_t nPoWHashDBCache = 8;
+//! -powcache default
+static const bool DEFAULT_POWCACHE = false;
+//! Fewest coins in a GetCoins batch for its reads to be handed to worker threads
+static const size_t MIN_COINS_PER_FETCH_THREAD = 16;
+//! -backgroundflush default
+static const bool DEFAULT_BACKGROUND_FLUSH = false;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -64,24 +77,64 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/**
+ * CCoinsView backed by the coin database (chainstate/)
+ *
+ * With background writes, BatchWrite copies the dirty entries aside and
+ * returns, leaving a writer thread to commit them. Until they are committed
+ * reads are answered from that copy first, so the view always reflects the
+ * last BatchWrite. The writer moves the head-blocks markers just like a
+ * synchronous write, so a crash halfway is recovered by ReplayBlocks.
+ */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
 public:
-    explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool fBackgroundWritesIn = false);
+    ~CCoinsViewDB();
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins, CCheckQueue<CCoinsFetch>* pqueue) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    //! Wait until a background write is committed. Returns false if it failed.
+    bool Sync() const;
+    //! Whether a background write is still in progress
+    bool IsWriting() const;
+    //! Memory held by coins the background writer has yet to commit
+    size_t WritingMemoryUsage() const;
+
+private:
+    uint256 ReadBestBlock() const;
+    void BeginWrite(CDBBatch& batch, const uint256& hashBlock);
+    void WritePartialBatch(CDBBatch& batch);
+    bool EndWrite(CDBBatch& batch, const uint256& hashBlock, size_t changed, size_t count);
+    bool WriteBehind();
+    void ThreadWriter();
+
+    const bool fBackgroundWrites;
+    mutable std::mutex csWriter;
+    mutable std::condition_variable condWriter;
+    std::thread threadWriter;
+    //! Dirty coins handed over by the last BatchWrite, erased as they are committed
+    std::unordered_map<COutPoint, Coin, SaltedOutpointHasher> mapWriting;
+    size_t nWritingUsage = 0;
+    //! Entries in the cache the last BatchWrite took mapWriting from
+    size_t nWritingTotal = 0;
+    //! Block mapWriting moves the database to, null once it is committed
+    uint256 hashWriting;
+    bool fWriting = false;
+    bool fWriteFailed = false;
+    bool fStopWriter = false;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -124,7 +177,23 @@ public:
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, const CPoWHashDB* powhashdb = nullptr);
+    //! Approximate number of block index entries, from the on-disk size of their records.
+    size_t EstimateBlockIndexEntries() const;
+};
+
+/** Access to the yespower hash cache (blocks/powcache/), mapping block hash to PoW hash */
+class CPoWHashDB : public CDBWrapper
+{
+public:
+    explicit CPoWHashDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    CPoWHashDB(const CPoWHashDB&) = delete;
+    CPoWHashDB& operator=(const CPoWHashDB&) = delete;
+
+    bool ReadPoWHash(const uint256 &hash, uint256 &powHash) const;
+    bool WritePoWHash(const uint256 &hash, const uint256 &powHash);
+    size_t EstimateSize() const;
 };
 
 #endif // BITCOIN_TXDB_H
@@ -575,6 +575,13 @@ void ArgsManager::ForceSetArg(const std::string& strArg, const std::string& strV
     mapMultiArgs[strArg] = {strValue};
 }
 
+void ArgsManager::ClearArg(const std::string& strArg)
+{
+    LOCK(cs_args);
+    mapArgs.erase(strArg);
+    mapMultiArgs.erase(strArg);
+}
+
 
 
 static const int screenWidth = 79;
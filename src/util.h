@@ -282,6 +282,10 @@ public:
     // Forces an arg setting. Called by SoftSetArg() if the arg hasn't already
     // been set. Also called directly in testing.
     void ForceSetArg(const std::string& strArg, const std::string& strValue);
+
+    // Removes an arg setting, as if it had never been set. Called directly
+    // in testing, to undo ForceSetArg().
+    void ClearArg(const std::string& strArg);
 };
 
 extern ArgsManager gArgs;
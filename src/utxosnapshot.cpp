@@ -0,0 +1,91 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <utxosnapshot.h>
+
+#include <clientversion.h>
+#include <streams.h>
+#include <util.h>
+#include <version.h>
+
+#include <stdio.h>
+
+#include <boost/thread.hpp>
+
+CUTXOSetHasher::CUTXOSetHasher(const uint256& hashBlock) : ss(SER_GETHASH, PROTOCOL_VERSION)
+{
+    ss << hashBlock;
+}
+
+void CUTXOSetHasher::AddTransaction()
+{
+    assert(!outputs.empty());
+    ss << hashTx;
+    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
+    nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out.scriptPubKey;
+        ss << VARINT(output.second.out.nValue);
+        nTransactionOutputs++;
+        nTotalAmount += output.second.out.nValue;
+        nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+                     2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
+    }
+    ss << VARINT(0);
+    outputs.clear();
+}
+
+void CUTXOSetHasher::Add(const COutPoint& outpoint, Coin coin)
+{
+    if (!outputs.empty() && outpoint.hash != hashTx)
+        AddTransaction();
+    hashTx = outpoint.hash;
+    outputs[outpoint.n] = std::move(coin);
+}
+
+uint256 CUTXOSetHasher::GetHash()
+{
+    if (!outputs.empty())
+        AddTransaction();
+    return ss.GetHash();
+}
+
+bool WriteUTXOSnapshot(CCoinsViewCursor* pcursor, CUTXOSnapshotHeader& header, const fs::path& path)
+{
+    fs::path pathTmp = path.string() + ".incomplete";
+    try {
+        CAutoFile file(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            return error("%s: unable to open %s", __func__, pathTmp.string());
+
+        // The count and the hash aren't known until the end, so the header is
+        // written once up front to make room and again when they are.
+        header.nCoins = 0;
+        file << header;
+        CUTXOSetHasher hasher(header.hashBlock);
+        for (; pcursor->Valid(); pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            COutPoint outpoint;
+            Coin coin;
+            if (!pcursor->GetKey(outpoint) || !pcursor->GetValue(coin))
+                return error("%s: unable to read value", __func__);
+            file << outpoint << coin;
+            hasher.Add(outpoint, std::move(coin));
+            header.nCoins++;
+        }
+        header.hashSerialized = hasher.GetHash();
+
+        if (fseek(file.Get(), 0, SEEK_SET) != 0)
+            return error("%s: unable to rewind %s", __func__, pathTmp.string());
+        file << header;
+        FileCommit(file.Get());
+        file.fclose();
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    if (!RenameOver(pathTmp, path))
+        return error("%s: unable to rename %s", __func__, pathTmp.string());
+    return true;
+}
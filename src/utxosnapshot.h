@@ -0,0 +1,105 @@
+// Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOSNAPSHOT_H
+#define BITCOIN_UTXOSNAPSHOT_H
+
+#include <amount.h>
+#include <coins.h>
+#include <fs.h>
+#include <hash.h>
+#include <primitives/transaction.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <ios>
+#include <map>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Hash of a UTXO set, as gettxoutsetinfo reports it in hash_serialized_2,
+ * computed one coin at a time in the order of the coins database. It commits
+ * to the block the set belongs to as well.
+ */
+class CUTXOSetHasher
+{
+public:
+    //! Totals of the set, complete once GetHash() was called
+    uint64_t nTransactions = 0;
+    uint64_t nTransactionOutputs = 0;
+    uint64_t nBogoSize = 0;
+    CAmount nTotalAmount = 0;
+
+    explicit CUTXOSetHasher(const uint256& hashBlock);
+
+    //! Add a coin. All coins of a transaction have to be added in a row.
+    void Add(const COutPoint& outpoint, Coin coin);
+    //! The hash of the coins added so far. Call once, after the last Add().
+    uint256 GetHash();
+
+private:
+    CHashWriter ss;
+    uint256 hashTx;
+    std::map<uint32_t, Coin> outputs;
+
+    void AddTransaction();
+};
+
+static const unsigned char UTXO_SNAPSHOT_MAGIC[5] = {'u', 't', 'x', 'o', 0xff};
+
+/**
+ * Header of a UTXO set snapshot, as written by the dumptxoutset RPC. The
+ * coins follow it as (COutPoint, Coin) pairs, in the order of the coins
+ * database, so that hashSerialized can be checked against gettxoutsetinfo
+ * of any node at the same block.
+ *
+ * Nothing loads snapshots yet. A node started from one would have to accept
+ * only snapshot hashes pinned in the chain parameters, and validate the
+ * blocks below the snapshot in a second chainstate in the background.
+ */
+class CUTXOSnapshotHeader
+{
+public:
+    static const uint16_t CURRENT_VERSION = 1;
+
+    uint16_t nVersion = CURRENT_VERSION;
+    //! The block the snapshot holds the UTXO set after
+    uint256 hashBlock;
+    int nHeight = 0;
+    //! Transactions in that block and up to it, which a node loading the
+    //! snapshot can't count itself without the blocks
+    unsigned int nTx = 0;
+    uint64_t nChainTx = 0;
+    uint64_t nCoins = 0;
+    uint256 hashSerialized;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s.write((const char*)UTXO_SNAPSHOT_MAGIC, sizeof(UTXO_SNAPSHOT_MAGIC));
+        s << nVersion << hashBlock << nHeight << nTx << nChainTx << nCoins << hashSerialized;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char magic[sizeof(UTXO_SNAPSHOT_MAGIC)];
+        s.read((char*)magic, sizeof(magic));
+        if (memcmp(magic, UTXO_SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+            throw std::ios_base::failure("not a UTXO snapshot");
+        s >> nVersion;
+        if (nVersion != CURRENT_VERSION)
+            throw std::ios_base::failure("unsupported UTXO snapshot version");
+        s >> hashBlock >> nHeight >> nTx >> nChainTx >> nCoins >> hashSerialized;
+    }
+};
+
+/**
+ * Write the coins pcursor walks over to a snapshot at path. The caller fills
+ * in the block fields of header; nCoins and hashSerialized are set here.
+ */
+bool WriteUTXOSnapshot(CCoinsViewCursor* pcursor, CUTXOSnapshotHeader& header, const fs::path& path);
+
+#endif // BITCOIN_UTXOSNAPSHOT_H
@@ -8,6 +8,7 @@
 #include <validation.h>
 
 #include <arith_uint256.h>
+#include <blockfilemap.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -23,6 +24,7 @@
 #include <policy/policy.h>
 #include <policy/rbf.h>
 #include <pow.h>
+#include <prefetchqueue.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <random.h>
@@ -208,6 +210,8 @@ private:
 CCriticalSection cs_main;
 
 BlockMap& mapBlockIndex = g_chainstate.mapBlockIndex;
+CBlockIndexArena blockIndexArena;
+CBlockFileMap blockFileMap;
 CChain& chainActive = g_chainstate.chainActive;
 CBlockIndex *pindexBestHeader = nullptr;
 CWaitableCriticalSection csBestBlock;
@@ -288,6 +292,66 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 std::unique_ptr<CCoinsViewDB> pcoinsdbview;
 std::unique_ptr<CCoinsViewCache> pcoinsTip;
 std::unique_ptr<CBlockTreeDB> pblocktree;
+std::unique_ptr<CPoWHashDB> ppowhashdb;
+
+/** Lookups in ppowhashdb that found / did not find the PoW hash */
+static std::atomic<uint64_t> nPoWCacheHits{0};
+static std::atomic<uint64_t> nPoWCacheMisses{0};
+
+/**
+ * Direct-mapped table of recently computed (block hash, PoW hash) pairs. It
+ * lets a block whose header was checked a moment ago skip yespower, now that
+ * CBlockIndex no longer carries a copy of the PoW hash.
+ */
+static const size_t RECENT_POW_HASHES = 4096;
+static CCriticalSection cs_recentpow;
+static std::pair<uint256, uint256> recentPoWHashes[RECENT_POW_HASHES];
+
+uint256 GetBlockPoWHash(const CBlockHeader& block)
+{
+    uint256 hash = block.GetHash();
+    LOCK(block.cache_lock);
+    if (!block.cache_init) {
+        std::pair<uint256, uint256>& recent = recentPoWHashes[hash.GetCheapHash() % RECENT_POW_HASHES];
+        uint256 powHash;
+        bool fFound;
+        {
+            LOCK(cs_recentpow);
+            fFound = recent.first == hash;
+            if (fFound)
+                powHash = recent.second;
+        }
+        if (!fFound && ppowhashdb) {
+            fFound = ppowhashdb->ReadPoWHash(hash, powHash);
+            if (fFound)
+                nPoWCacheHits++;
+            else
+                nPoWCacheMisses++;
+        }
+        if (!fFound) {
+            powHash = block.GetPoWHash();
+            // Only remember hashes that pass, so junk headers cannot evict or grow the caches.
+            if (CheckProofOfWork(powHash, block.nBits, Params().GetConsensus())) {
+                if (ppowhashdb)
+                    ppowhashdb->WritePoWHash(hash, powHash);
+                LOCK(cs_recentpow);
+                recent = std::make_pair(hash, powHash);
+            }
+        }
+        block.cache_PoW_hash = powHash;
+        block.cache_block_hash = hash;
+        block.cache_init = true;
+    }
+    return block.GetPoWHash_cached();
+}
+
+bool GetPoWCacheStats(uint64_t& nHits, uint64_t& nMisses, size_t& nSizeOnDisk)
+{
+    nHits = nPoWCacheHits;
+    nMisses = nPoWCacheMisses;
+    nSizeOnDisk = ppowhashdb ? ppowhashdb->EstimateSize() : 0;
+    return ppowhashdb != nullptr;
+}
 
 enum FlushStateMode {
     FLUSH_STATE_NONE,
@@ -301,7 +365,9 @@ static bool FlushStateToDisk(const CChainParams& chainParams, CValidationState &
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
 static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
+static bool CheckInputsForMempool(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata);
 static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
+static std::shared_ptr<const CMappedFile> MapDiskRecord(const CDiskBlockPos& pos, const char* prefix, unsigned int nTrailing, const unsigned char*& pbegin, const unsigned char*& pend);
 
 bool CheckFinalTx(const CTransaction &tx, int flags)
 {
@@ -546,7 +612,7 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
         }
     }
 
-    return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
+    return CheckInputsForMempool(tx, state, view, flags, cacheSigStore, true, txdata);
 }
 
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
@@ -902,7 +968,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
+        if (!CheckInputsForMempool(tx, state, view, scriptVerifyFlags, true, false, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
@@ -1108,21 +1174,27 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-
-    // Read block
+    // Read block, from the mapped file if possible
+    const unsigned char* pbegin;
+    const unsigned char* pend;
+    std::shared_ptr<const CMappedFile> mapped = MapDiskRecord(pos, "blk", 0, pbegin, pend);
     try {
-        filein >> block;
+        if (mapped) {
+            CMemoryReader reader(SER_DISK, CLIENT_VERSION, pbegin, pend);
+            reader >> block;
+        } else {
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+            filein >> block;
+        }
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
     }
 
     // Check the header
-    if (!CheckProofOfWork(block.GetPoWHash_cached(), block.nBits, consensusParams))
+    if (!CheckProofOfWork(GetBlockPoWHash(block), block.nBits, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
     return true;
@@ -1144,6 +1216,68 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+/** Read the block at pos with stdio, checking the index header WriteBlockToDisk put in front of it */
+static bool ReadRawBlockFromFile(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    if (pos.nPos < CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("ReadRawBlockFromDisk: no index header before %s", pos.ToString());
+    CDiskBlockPos hpos = pos;
+    hpos.nPos -= CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("ReadRawBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+    try {
+        unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+        unsigned int nSize = 0;
+        filein >> FLATDATA(buf) >> nSize;
+        if (memcmp(buf, messageStart, CMessageHeader::MESSAGE_START_SIZE))
+            return error("ReadRawBlockFromDisk: block magic mismatch at %s", pos.ToString());
+        if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+            return error("ReadRawBlockFromDisk: invalid block size %u at %s", nSize, pos.ToString());
+        block.resize(nSize);
+        filein.read((char*)block.data(), nSize);
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const uint256& hash, const CMessageHeader::MessageStartChars& messageStart)
+{
+    const unsigned char* pbegin;
+    const unsigned char* pend;
+    std::shared_ptr<const CMappedFile> mapped = MapDiskRecord(pos, "blk", 0, pbegin, pend);
+    if (mapped) {
+        if (pend - pbegin < 80 || pend - pbegin > (ptrdiff_t)MAX_BLOCK_SERIALIZED_SIZE)
+            return error("ReadRawBlockFromDisk: invalid block size %u at %s", pend - pbegin, pos.ToString());
+        block.assign(pbegin, pend);
+    } else if (!ReadRawBlockFromFile(block, pos, messageStart)) {
+        return false;
+    }
+
+    // The serialized block starts with its 80 byte header. Its proof of work
+    // was checked when the block was accepted, so comparing the hash is enough
+    // to catch a file reused after pruning.
+    if (Hash(block.begin(), block.begin() + 80) != hash)
+        return error("ReadRawBlockFromDisk: header hash doesn't match %s at %s", hash.ToString(), pos.ToString());
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    CDiskBlockPos blockPos;
+    {
+        LOCK(cs_main);
+        blockPos = pindex->GetBlockPos();
+    }
+
+    return ReadRawBlockFromDisk(block, blockPos, pindex->GetBlockHash(), messageStart);
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1383,7 +1517,14 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
-    return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
+    if (VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error))
+        return true;
+    if (pnFailedIn) {
+        // Keep the lowest failing input, whichever check gets there first
+        unsigned int nFailedIn = *pnFailedIn;
+        while (nIn < nFailedIn && !pnFailedIn->compare_exchange_weak(nFailedIn, nIn)) {}
+    }
+    return false;
 }
 
 int GetSpendHeight(const CCoinsViewCache& inputs)
@@ -1406,6 +1547,48 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+/** The key of a transaction's entry in the script execution cache, for the given flags */
+static uint256 ScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    // We only use the first 19 bytes of nonce to avoid a second SHA
+    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
+/**
+ * Verify the script of input nIn of tx, which spends txout, inline. If it
+ * fails, state gets the reject reason.
+ */
+static bool CheckInputScript(const CTransaction& tx, CValidationState &state, const CTxOut& txout, unsigned int nIn, unsigned int flags, bool cacheSigStore, PrecomputedTransactionData& txdata)
+{
+    CScriptCheck check(txout, tx, nIn, flags, cacheSigStore, &txdata);
+    if (check())
+        return true;
+    if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
+        // Check whether the failure was caused by a
+        // non-mandatory script verification check, such as
+        // non-standard DER encodings or non-null dummy
+        // arguments; if so, don't trigger DoS protection to
+        // avoid splitting the network between upgraded and
+        // non-upgraded nodes.
+        CScriptCheck check2(txout, tx, nIn,
+                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, &txdata);
+        if (check2())
+            return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
+    }
+    // Failures of other flags indicate a transaction that is
+    // invalid in new blocks, e.g. an invalid P2SH. We DoS ban
+    // such nodes as they are not following the protocol. That
+    // said during an upgrade careful thought should be taken
+    // as to the correct behavior - we may want to continue
+    // peering with non-upgraded nodes even after soft-fork
+    // super-majority signaling has occurred.
+    return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
+}
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set.
@@ -1442,11 +1625,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             // correct (ie that the transaction hash which is in tx's prevouts
             // properly commits to the scriptPubKey in the inputs view of that
             // transaction).
-            uint256 hashCacheEntry;
-            // We only use the first 19 bytes of nonce to avoid a second SHA
-            // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
-            static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
-            CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+            uint256 hashCacheEntry = ScriptExecutionCacheEntry(tx, flags);
             AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
             if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
                 return true;
@@ -1464,31 +1643,12 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                 // spent being checked as a part of CScriptCheck.
 
                 // Verify signature
-                CScriptCheck check(coin.out, tx, i, flags, cacheSigStore, &txdata);
                 if (pvChecks) {
+                    CScriptCheck check(coin.out, tx, i, flags, cacheSigStore, &txdata);
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
-                } else if (!check()) {
-                    if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
-                        // Check whether the failure was caused by a
-                        // non-mandatory script verification check, such as
-                        // non-standard DER encodings or non-null dummy
-                        // arguments; if so, don't trigger DoS protection to
-                        // avoid splitting the network between upgraded and
-                        // non-upgraded nodes.
-                        CScriptCheck check2(coin.out, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, &txdata);
-                        if (check2())
-                            return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
-                    }
-                    // Failures of other flags indicate a transaction that is
-                    // invalid in new blocks, e.g. an invalid P2SH. We DoS ban
-                    // such nodes as they are not following the protocol. That
-                    // said during an upgrade careful thought should be taken
-                    // as to the correct behavior - we may want to continue
-                    // peering with non-upgraded nodes even after soft-fork
-                    // super-majority signaling has occurred.
-                    return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
+                } else if (!CheckInputScript(tx, state, coin.out, i, flags, cacheSigStore, txdata)) {
+                    return false;
                 }
             }
 
@@ -1532,6 +1692,18 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+/** Read undo data and the checksum following it; returns whether the checksum matches */
+template <typename Stream>
+static bool UndoReadChecked(Stream& s, CBlockUndo& blockundo, const uint256& hashPrevBlock)
+{
+    uint256 hashChecksum;
+    CHashVerifier<Stream> verifier(&s); // We need a CHashVerifier as reserializing may lose data
+    verifier << hashPrevBlock;
+    verifier >> blockundo;
+    s >> hashChecksum;
+    return hashChecksum == verifier.GetHash();
+}
+
 static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
 {
     CDiskBlockPos pos = pindex->GetUndoPos();
@@ -1539,25 +1711,28 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
         return error("%s: no undo data available", __func__);
     }
 
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
-    // Read block
-    uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
+    // Read undo data, from the mapped file if possible
+    const unsigned char* pbegin;
+    const unsigned char* pend;
+    std::shared_ptr<const CMappedFile> mapped = MapDiskRecord(pos, "rev", sizeof(uint256), pbegin, pend);
+    bool fChecksumOK;
     try {
-        verifier << pindex->pprev->GetBlockHash();
-        verifier >> blockundo;
-        filein >> hashChecksum;
+        if (mapped) {
+            CMemoryReader reader(SER_DISK, CLIENT_VERSION, pbegin, pend);
+            fChecksumOK = UndoReadChecked(reader, blockundo, pindex->pprev->GetBlockHash());
+        } else {
+            CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("%s: OpenUndoFile failed", __func__);
+            fChecksumOK = UndoReadChecked(filein, blockundo, pindex->pprev->GetBlockHash());
+        }
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
     }
 
     // Verify checksum
-    if (hashChecksum != verifier.GetHash())
+    if (!fChecksumOK)
         return error("%s: Checksum mismatch", __func__);
 
     return true;
@@ -1682,18 +1857,30 @@ void static FlushBlockFile(bool fFinalize = false)
 
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
+    // Mappings must not reach past the end of a truncated file. A reader may
+    // map the file again at its old size before it's truncated, so each file
+    // is forgotten once more afterwards.
+    if (fFinalize) {
+        blockFileMap.Forget(GetBlockPosFilename(posOld, "blk"));
+        blockFileMap.Forget(GetBlockPosFilename(posOld, "rev"));
+    }
+
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+            blockFileMap.Forget(GetBlockPosFilename(posOld, "blk"));
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
 
     fileOld = OpenUndoFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
+            blockFileMap.Forget(GetBlockPosFilename(posOld, "rev"));
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -1740,6 +1927,7 @@ static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& stat
     return true;
 }
 
+static_assert(MAX_SCRIPTCHECK_THREADS <= MAX_CHECKQUEUE_THREADS, "-par allows more threads than a CCheckQueue takes");
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
 void ThreadScriptCheck() {
@@ -1747,6 +1935,95 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * CheckInputs for mempool acceptance. The scripts of transactions with many
+ * inputs are verified on the script-checking threads. If one fails, the inputs
+ * up to it are checked again inline, in order, so state gets the reject reason
+ * CheckInputs gives.
+ */
+static bool CheckInputsForMempool(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata)
+{
+    if (!nScriptCheckThreads || tx.vin.size() < MIN_PARALLEL_MEMPOOL_INPUTS)
+        return CheckInputs(tx, state, inputs, true, flags, cacheSigStore, cacheFullScriptStore, txdata);
+
+    AssertLockHeld(cs_main); // ConnectBlock, the queue's only other user, holds it too
+    std::vector<CScriptCheck> vChecks;
+    if (!CheckInputs(tx, state, inputs, true, flags, cacheSigStore, cacheFullScriptStore, txdata, &vChecks))
+        return false;
+    if (vChecks.empty()) // found in the script execution cache
+        return true;
+    std::atomic<unsigned int> nFailedIn{(unsigned int)tx.vin.size()};
+    for (CScriptCheck& check : vChecks)
+        check.ReportFailureTo(&nFailedIn);
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    if (!control.Wait()) {
+        // The queue stops once a check fails, so lower inputs that would fail
+        // too may not have been run
+        const unsigned int nLastIn = nFailedIn;
+        assert(nLastIn < tx.vin.size());
+        for (unsigned int nIn = 0; nIn <= nLastIn; nIn++) {
+            if (!CheckInputScript(tx, state, inputs.AccessCoin(tx.vin[nIn].prevout).out, nIn, flags, cacheSigStore, txdata))
+                return false;
+        }
+        // Scripts are deterministic, so this shouldn't happen; let CheckInputs decide
+        return CheckInputs(tx, state, inputs, true, flags, cacheSigStore, cacheFullScriptStore, txdata);
+    }
+    if (cacheFullScriptStore)
+        scriptExecutionCache.insert(ScriptExecutionCacheEntry(tx, flags));
+    return true;
+}
+
+/**
+ * Closure representing the yespower evaluation of one block header.
+ * It only fills the header's PoW cache; the header is judged later by
+ * CheckBlockHeader(), which then finds the cached hash.
+ */
+class CHeaderPoWCheck
+{
+private:
+    const CBlockHeader *pheader;
+
+public:
+    CHeaderPoWCheck(): pheader(nullptr) {}
+    explicit CHeaderPoWCheck(const CBlockHeader& headerIn) : pheader(&headerIn) {}
+
+    bool operator()() {
+        GetBlockPoWHash(*pheader);
+        return true;
+    }
+
+    void swap(CHeaderPoWCheck &check) {
+        std::swap(pheader, check.pheader);
+    }
+};
+
+// One header per batch: a single yespower evaluation already dwarfs the queue overhead.
+static CCheckQueue<CHeaderPoWCheck> powcheckqueue(1);
+
+void ThreadPoWCheck() {
+    RenameThread("sugarchain-powch");
+    powcheckqueue.Thread();
+}
+
+static CCheckQueue<CCoinsFetch> coinsfetchqueue(MIN_COINS_PER_FETCH_THREAD);
+
+void ThreadCoinsFetch() {
+    RenameThread("sugarchain-coinsfetch");
+    coinsfetchqueue.Thread();
+}
+
+static CPrefetchPool blockprefetchpool;
+
+void ThreadBlockPrefetch() {
+    RenameThread("sugarchain-prefetch");
+    blockprefetchpool.Thread();
+}
+
+CPrefetchPool* GetBlockPrefetchPool() {
+    return nScriptCheckThreads ? &blockprefetchpool : nullptr;
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1962,6 +2239,24 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
 
+    // Warm the view with the coins the block spends, other than those it
+    // creates itself, so its cache misses are read from the database on
+    // -par threads rather than one by one in the loop below.
+    {
+        std::set<uint256> setBlockTxids;
+        std::vector<COutPoint> vPrevouts;
+        for (const auto& tx : block.vtx) {
+            if (!tx->IsCoinBase()) {
+                for (const CTxIn& txin : tx->vin) {
+                    if (!setBlockTxids.count(txin.prevout.hash))
+                        vPrevouts.push_back(txin.prevout);
+                }
+            }
+            setBlockTxids.insert(tx->GetHash());
+        }
+        view.PrefetchCoins(vPrevouts, nScriptCheckThreads ? &coinsfetchqueue : nullptr);
+    }
+
     CBlockUndo blockundo;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
@@ -2119,10 +2414,12 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             nLastSetChain = nNow;
         }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        // Coins still being written out in the background count against the limit too.
+        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() + pcoinsdbview->WritingMemoryUsage();
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
-        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
+        // Not while the last flush is still being written, though, as this one would have to wait for it.
+        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && !pcoinsdbview->IsWriting() && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
         // The cache is over the limit, we have to write now.
         bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nTotalSpace;
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
@@ -2156,9 +2453,13 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                     return AbortNode(state, "Failed to write to block index database");
                 }
             }
-            // Finally remove any pruned files
-            if (fFlushForPrune)
+            // Finally remove any pruned files, once no coins write in progress
+            // may need their blocks to be replayed after a crash.
+            if (fFlushForPrune) {
+                if (!pcoinsdbview->Sync())
+                    return AbortNode(state, "Failed to write to coin database");
                 UnlinkPrunedFiles(setFilesToPrune);
+            }
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -2168,10 +2469,24 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // twice (once in the log, and once in the tables). This is already
             // an overestimation, as most will delete an existing entry or
             // overwrite one. Still, use a conservative safety factor of 2.
-            if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
+            // Only the modified coins are written; the rest stay cached.
+            if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetDirtyCount()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // Only the changes are written; the coins stay cached so that
+            // validation does not go on from a cold cache.
+            if (!pcoinsTip->Sync())
+                return AbortNode(state, "Failed to write to coin database");
+            // If the cache is what was too large, evict the least recently
+            // used coins, making room for what is still being written.
+            if (fCacheLarge || fCacheCritical) {
+                int64_t nTargetUsage = nTotalSpace * COINS_CACHE_TRIM_PERCENT / 100 - pcoinsdbview->WritingMemoryUsage();
+                pcoinsTip->Trim(std::max<int64_t>(nTargetUsage, 0));
+            }
+            // The chainstate may be written in the background from here, but
+            // callers flushing always (shutdown, RPCs reading the database)
+            // and pruning need it on disk before going on.
+            if ((mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && !pcoinsdbview->Sync())
                 return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
         }
@@ -2880,7 +3195,8 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -2895,6 +3211,7 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
         pindexNew->BuildSkip();
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
+    pindexNew->BuildMedianTimePast();
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == nullptr || pindexBestHeader->nChainWork < pindexNew->nChainWork)
@@ -3045,7 +3362,7 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
 static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
 {
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetPoWHash_cached(), block.nBits, consensusParams))
+    if (fCheckPOW && !CheckProofOfWork(GetBlockPoWHash(block), block.nBits, consensusParams))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     // FIXME.SUGAR // check PoW: SKIPPED during downloading headers (IBD)
@@ -3389,6 +3706,24 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+    // Compute yespower for all headers we have not seen yet on the PoW check
+    // threads (each with its own thread-local scratchpad), so AcceptBlockHeader()
+    // below only hits the per-header PoW cache. The PoW itself is skipped during
+    // IBD, so there is nothing to precompute then.
+    if (headers.size() > 1 && nScriptCheckThreads && !IsInitialBlockDownload()) {
+        std::vector<CHeaderPoWCheck> vChecks;
+        vChecks.reserve(headers.size());
+        {
+            LOCK(cs_main);
+            for (const CBlockHeader& header : headers) {
+                if (mapBlockIndex.count(header.GetHash()) == 0)
+                    vChecks.emplace_back(header);
+            }
+        }
+        CCheckQueueControl<CHeaderPoWCheck> control(&powcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
     {
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
@@ -3516,26 +3851,6 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
 {
     AssertLockNotHeld(cs_main);
 
-    // Look for this block's header in the index like AcceptBlock() will
-    uint256 hash = pblock->GetHash();
-
-    {
-        LOCK(cs_main);
-
-        BlockMap::iterator miSelf = mapBlockIndex.find(hash);
-        CBlockIndex *pindex = NULL;
-        if (miSelf != mapBlockIndex.end()) {
-            // Block header is already known
-            pindex = miSelf->second;
-            if (!pblock->cache_init && pindex->cache_init) {
-                LOCK(pblock->cache_lock); // Probably unnecessary since no concurrent access to pblock is expected
-                pblock->cache_init = true;
-                pblock->cache_block_hash = pindex->cache_block_hash;
-                pblock->cache_PoW_hash = pindex->cache_PoW_hash;
-            }
-        }
-    }
-
     {
         CBlockIndex *pindex = nullptr;
         if (fNewBlock) *fNewBlock = false;
@@ -3643,6 +3958,8 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        blockFileMap.Forget(GetBlockPosFilename(pos, "blk"));
+        blockFileMap.Forget(GetBlockPosFilename(pos, "rev"));
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3784,6 +4101,38 @@ static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly) {
     return OpenDiskFile(pos, "rev", fReadOnly);
 }
 
+/**
+ * Locate the record WriteBlockToDisk or UndoWriteToDisk stored at pos in a
+ * mapped blk/rev file. On success pbegin and pend delimit the record plus
+ * nTrailing bytes after it, and stay valid while the returned mapping is
+ * held. Returns nullptr if the file isn't mapped or the index header before
+ * pos doesn't check out; callers then read the file with stdio as before.
+ */
+static std::shared_ptr<const CMappedFile> MapDiskRecord(const CDiskBlockPos& pos, const char* prefix, unsigned int nTrailing, const unsigned char*& pbegin, const unsigned char*& pend)
+{
+    const unsigned int nHeaderSize = CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+    if (pos.IsNull() || pos.nPos < nHeaderSize)
+        return nullptr;
+    const fs::path path = GetBlockPosFilename(pos, prefix);
+    std::shared_ptr<const CMappedFile> mapped = blockFileMap.Get(path, pos.nPos);
+    if (!mapped)
+        return nullptr;
+
+    const unsigned char* pheader = mapped->data() + pos.nPos - nHeaderSize;
+    if (memcmp(pheader, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+        return nullptr;
+    const uint64_t nEnd = (uint64_t)pos.nPos + ReadLE32(pheader + CMessageHeader::MESSAGE_START_SIZE) + nTrailing;
+    if (nEnd > mapped->size()) {
+        // Appended to since it was mapped
+        mapped = blockFileMap.Get(path, nEnd);
+        if (!mapped)
+            return nullptr;
+    }
+    pbegin = mapped->data() + pos.nPos;
+    pend = mapped->data() + nEnd;
+    return mapped;
+}
+
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix)
 {
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
@@ -3800,7 +4149,7 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -3809,24 +4158,58 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
 
 bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash){ return this->InsertBlockIndex(hash); }))
+    // Size the hash table once instead of rehashing it over and over while
+    // millions of entries are inserted.
+    mapBlockIndex.reserve(blocktree.EstimateBlockIndexEntries());
+    int64_t nTimeStart = GetTimeMillis();
+    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash){ return this->InsertBlockIndex(hash); }, ppowhashdb.get()))
         return false;
+    int64_t nTimeRead = GetTimeMillis();
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    for (const std::pair<uint256, CBlockIndex*>& item : mapBlockIndex)
+    // Order the entries by height. Heights are dense, so bucket them instead of sorting.
+    int nMaxHeight = -1;
+    for (const auto& item : mapBlockIndex)
+        nMaxHeight = std::max(nMaxHeight, item.second->nHeight);
+    std::vector<size_t> vHeightStart(nMaxHeight + 2, 0);
+    for (const auto& item : mapBlockIndex)
+        vHeightStart[item.second->nHeight + 1]++;
+    for (int nHeight = 0; nHeight <= nMaxHeight; nHeight++)
+        vHeightStart[nHeight + 1] += vHeightStart[nHeight];
+    std::vector<CBlockIndex*> vSortedByHeight(mapBlockIndex.size());
+    for (const auto& item : mapBlockIndex)
+        vSortedByHeight[vHeightStart[item.second->nHeight]++] = item.second;
+    int64_t nTimeSort = GetTimeMillis();
+
+    // GetBlockProof() is a 256-bit division per entry, independent of every
+    // other entry: compute it on all cores, parking it in nChainWork until the
+    // serial pass below turns it into the running total. The median time past
+    // only reads the ancestors' timestamps, so it is cached here as well.
     {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        const size_t nThreads = std::max(1, GetNumCores());
+        const size_t nChunk = (vSortedByHeight.size() + nThreads - 1) / nThreads;
+        std::vector<std::future<void>> vWorkers;
+        for (size_t nBegin = 0; nBegin < vSortedByHeight.size(); nBegin += nChunk) {
+            size_t nEnd = std::min(nBegin + nChunk, vSortedByHeight.size());
+            vWorkers.push_back(std::async(std::launch::async, [&vSortedByHeight, nBegin, nEnd] {
+                for (size_t i = nBegin; i < nEnd; i++) {
+                    vSortedByHeight[i]->nChainWork = GetBlockProof(*vSortedByHeight[i]);
+                    vSortedByHeight[i]->BuildMedianTimePast();
+                }
+            }));
+        }
+        for (std::future<void>& worker : vWorkers)
+            worker.get();
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
+    int64_t nTimeProof = GetTimeMillis();
+
+    // Skip pointers and chain totals depend on the ancestors' values, so link
+    // the entries in height order on this thread.
+    for (CBlockIndex* pindex : vSortedByHeight)
     {
-        CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        if (pindex->pprev)
+            pindex->nChainWork += pindex->pprev->nChainWork;
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
@@ -3855,6 +4238,10 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
+    int64_t nTimeLink = GetTimeMillis();
+
+    LogPrintf("%s: %u entries: read %dms, sort %dms, block proof %dms, link %dms\n", __func__, vSortedByHeight.size(),
+        nTimeRead - nTimeStart, nTimeSort - nTimeRead, nTimeProof - nTimeSort, nTimeLink - nTimeProof);
 
     return true;
 }
@@ -3863,6 +4250,7 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
 {
     if (!g_chainstate.LoadBlockIndex(chainparams.GetConsensus(), *pblocktree))
         return false;
+    LogPrintf("%s: %u block index entries using %.1fMiB\n", __func__, blockIndexArena.Size(), blockIndexArena.DynamicMemoryUsage() * (1.0 / 1024 / 1024));
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -4269,10 +4657,8 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
     fHavePruned = false;
 
     g_chainstate.UnloadBlockIndex();
@@ -4335,6 +4721,21 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
+namespace {
+
+/** A block record found while importing a block file, queued for prefetching */
+struct ImportRecord
+{
+    uint64_t nRewind;   //!< where to resume scanning if the record doesn't deserialize
+    uint64_t nBlockPos; //!< position of the serialized block in the file
+    unsigned int nSize; //!< size from the record's index header
+};
+
+/** A deserialized block, or nullptr, and how many of the record's bytes it took */
+typedef std::pair<std::shared_ptr<CBlock>, unsigned int> ImportedBlock;
+
+} // namespace
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
@@ -4343,43 +4744,93 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
 
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor.
+        // The rewind margin also covers the records read ahead of the one being processed.
+        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE+MAX_IMPORT_PREFETCH_BYTES, MAX_BLOCK_SERIALIZED_SIZE+MAX_IMPORT_PREFETCH_BYTES+8, SER_DISK, CLIENT_VERSION);
+        // Blocks are deserialized and their PoW hashed on -par threads
+        // while this one accepts the blocks before them in order.
+        CPrefetchQueue<ImportedBlock> prefetch(GetBlockPrefetchPool());
+        std::deque<ImportRecord> queued;
+        bool fScannedToEnd = false;
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        while (true) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+            // Queue the records that follow, up to the read-ahead limits
+            while (!fScannedToEnd && queued.size() < MAX_BLOCKS_PREFETCHED &&
+                   (queued.empty() || nRewind - queued.front().nRewind < MAX_IMPORT_PREFETCH_BYTES)) {
+                blkdat.SetPos(nRewind);
+                if (blkdat.eof()) {
+                    fScannedToEnd = true;
+                    break;
+                }
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                    blkdat.FindByte(chainparams.MessageStart()[0]);
+                    nRewind = blkdat.GetPos()+1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    fScannedToEnd = true;
+                    break;
+                }
+                uint64_t nBlockPos = blkdat.GetPos();
+                std::shared_ptr<std::vector<unsigned char>> data = std::make_shared<std::vector<unsigned char>>(nSize);
+                try {
+                    blkdat.read((char*)data->data(), nSize);
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
                     continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
+                }
+                queued.push_back(ImportRecord{nRewind, nBlockPos, nSize});
+                nRewind = nBlockPos + nSize;
+                prefetch.Push([data] {
+                    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                    CMemoryReader reader(SER_DISK, CLIENT_VERSION, data->data(), data->data() + data->size());
+                    try {
+                        reader >> *pblock;
+                    } catch (const std::exception& e) {
+                        LogPrintf("LoadExternalBlockFile: Deserialize or I/O error - %s\n", e.what());
+                        return ImportedBlock(nullptr, 0);
+                    }
+                    // Fill the header's PoW cache so AcceptBlock doesn't run yespower
+                    GetBlockPoWHash(*pblock);
+                    return ImportedBlock(pblock, data->size() - reader.size());
+                });
+            }
+            if (queued.empty())
                 break;
+
+            const ImportRecord record = queued.front();
+            queued.pop_front();
+            std::shared_ptr<CBlock> pblock;
+            unsigned int nRead;
+            std::tie(pblock, nRead) = prefetch.Pop();
+            if (!pblock || nRead != record.nSize) {
+                // The records queued after this one were found by skipping over
+                // its declared size. Scan again from one byte past its magic if
+                // it didn't deserialize, or from where the block ended.
+                prefetch.Clear();
+                queued.clear();
+                fScannedToEnd = false;
+                nRewind = pblock ? record.nBlockPos + nRead : record.nRewind;
+                if (!pblock)
+                    continue;
             }
             try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                    dbp->nPos = record.nBlockPos;
                 CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
 
                 // detect out of order blocks, and store them for later
                 uint256 hash = block.GetHash();
@@ -4817,9 +5268,7 @@ public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
     }
 } instance_of_cmaincleanup;
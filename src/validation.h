@@ -31,11 +31,14 @@
 
 #include <atomic>
 
+class CBlockFileMap;
 class CBlockIndex;
 class CBlockTreeDB;
 class CChainParams;
 class CCoinsViewDB;
 class CInv;
+class CPoWHashDB;
+class CPrefetchPool;
 class CConnman;
 class CScriptCheck;
 class CBlockPolicyEstimator;
@@ -78,9 +81,21 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
 /** Maximum number of script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 16;
+static const int MAX_SCRIPTCHECK_THREADS = 128;
+/** Most of the -par threads that verify header PoW, each with its own yespower scratch memory */
+static const int MAX_POWCHECK_THREADS = 16;
+/** Most of the -par threads that read coins from the database */
+static const int MAX_COINS_FETCH_THREADS = 8;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Fewest inputs of a transaction entering the mempool for its scripts to be verified on -par threads */
+static const unsigned int MIN_PARALLEL_MEMPOOL_INPUTS = 8;
+/** Blocks read ahead of the one being imported or rescanned, on -par threads */
+static const unsigned int MAX_BLOCKS_PREFETCHED = 64;
+/** Most of the -par threads that read blocks ahead, the importing or rescanning one included */
+static const int MAX_BLOCK_PREFETCH_THREADS = 16;
+/** Bytes of a block file scanned ahead of the block being imported */
+static const unsigned int MAX_IMPORT_PREFETCH_BYTES = 0x400000; // 4 MiB
 
 /** Number of blocks that can be requested at any given time from a single peer. */
 // FIXME.SUGAR
@@ -111,6 +126,8 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Share of the coins cache limit (in percent) a cache that grew too large is trimmed down to. */
+static const int64_t COINS_CACHE_TRIM_PERCENT = 80;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Average delay between local address broadcasts in seconds. */
@@ -170,6 +187,10 @@ extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
 typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap& mapBlockIndex;
+/** Owns the CBlockIndex entries in mapBlockIndex (protected by cs_main) */
+extern CBlockIndexArena blockIndexArena;
+/** Block and undo files kept memory-mapped for reading (-mmapblockfiles) */
+extern CBlockFileMap blockFileMap;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockWeight;
 extern const std::string strMessageMagic;
@@ -283,6 +304,14 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header PoW checking thread */
+void ThreadPoWCheck();
+/** Run an instance of the thread reading coins ConnectBlock prefetches */
+void ThreadCoinsFetch();
+/** Run an instance of the thread reading blocks ahead during reindex and rescan */
+void ThreadBlockPrefetch();
+/** The threads reading blocks ahead, or nullptr without -par threads */
+CPrefetchPool* GetBlockPrefetchPool();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -379,11 +408,12 @@ private:
     bool cacheStore;
     ScriptError error;
     PrecomputedTransactionData *txdata;
+    std::atomic<unsigned int> *pnFailedIn;
 
 public:
-    CScriptCheck(): ptxTo(nullptr), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck(): ptxTo(nullptr), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), pnFailedIn(nullptr) {}
     CScriptCheck(const CTxOut& outIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
-        m_tx_out(outIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+        m_tx_out(outIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), pnFailedIn(nullptr) { }
 
     bool operator()();
 
@@ -395,9 +425,14 @@ public:
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
         std::swap(txdata, check.txdata);
+        std::swap(pnFailedIn, check.pnFailedIn);
     }
 
     ScriptError GetScriptError() const { return error; }
+
+    //! Have a failing check lower *pnFailedInIn to its input index, as the
+    //! check itself is gone once a CCheckQueue ran it
+    void ReportFailureTo(std::atomic<unsigned int> *pnFailedInIn) { pnFailedIn = pnFailedInIn; }
 };
 
 /** Initializes the script-execution cache */
@@ -407,6 +442,12 @@ void InitScriptExecutionCache();
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/**
+ * Read a block's serialized bytes as stored on disk (with witness data),
+ * without deserializing it. Only the header hash is checked.
+ */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const uint256& hash, const CMessageHeader::MessageStartChars& messageStart);
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -463,6 +504,15 @@ extern std::unique_ptr<CCoinsViewCache> pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern std::unique_ptr<CBlockTreeDB> pblocktree;
 
+/** Global variable that points to the PoW hash cache, or nullptr without -powcache */
+extern std::unique_ptr<CPoWHashDB> ppowhashdb;
+
+/** Return the yespower hash of a header, consulting and filling ppowhashdb if enabled. */
+uint256 GetBlockPoWHash(const CBlockHeader& block);
+
+/** Report PoW hash cache lookups since startup and its size on disk. Returns whether the cache is enabled. */
+bool GetPoWCacheStats(uint64_t& nHits, uint64_t& nMisses, size_t& nSizeOnDisk);
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
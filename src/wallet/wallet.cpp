@@ -20,6 +20,7 @@
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
+#include <prefetchqueue.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
@@ -1633,6 +1634,9 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
             dProgressTip = GuessVerificationProgress(chainParams.TxData(), tip);
         }
+        // Upcoming blocks are read, and their PoW checked, on -par threads
+        CPrefetchQueue<std::shared_ptr<const CBlock>> prefetch(GetBlockPrefetchPool());
+        std::deque<CBlockIndex*> queued; // blocks in prefetch, in order
         while (pindex && !fAbortRescan)
         {
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
@@ -1649,8 +1653,29 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            {
+                LOCK(cs_main);
+                if (!queued.empty() && queued.front() != pindex) {
+                    // The chain was reorganized under the blocks read ahead
+                    prefetch.Clear();
+                    queued.clear();
+                }
+                CBlockIndex* pnext = queued.empty() ? pindex : queued.back() == pindexStop ? nullptr : chainActive.Next(queued.back());
+                while (pnext && queued.size() < MAX_BLOCKS_PREFETCHED) {
+                    prefetch.Push([pnext]() -> std::shared_ptr<const CBlock> {
+                        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                        if (!ReadBlockFromDisk(*pblock, pnext, Params().GetConsensus()))
+                            return nullptr;
+                        return pblock;
+                    });
+                    queued.push_back(pnext);
+                    pnext = pnext == pindexStop ? nullptr : chainActive.Next(pnext);
+                }
+            }
+            std::shared_ptr<const CBlock> pblock = prefetch.Pop();
+            queued.pop_front();
+            if (pblock) {
+                const CBlock& block = *pblock;
                 LOCK2(cs_main, cs_wallet);
                 if (pindex && !chainActive.Contains(pindex)) {
                     // Abort scan if current block is no longer active, to prevent
@@ -56,7 +56,8 @@ class ChainstateWriteCrashTest(BitcoinTestFramework):
         # -dbcache goes to pcoinsTip.
         self.node0_args = ["-dbcrashratio=8", "-dbcache=4"] + self.base_args
         self.node1_args = ["-dbcrashratio=16", "-dbcache=8"] + self.base_args
-        self.node2_args = ["-dbcrashratio=24", "-dbcache=16"] + self.base_args
+        # Background writes have to survive a crash as well
+        self.node2_args = ["-dbcrashratio=24", "-dbcache=16", "-backgroundflush"] + self.base_args
 
         # Node3 is a normal node with default args, except will mine full blocks
         self.node3_args = ["-blockmaxweight=4000000"]
@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the internal miner (-gen).
+
+- A fresh regtest chain is in initial block download, so the miner waits.
+- One block mined over RPC leaves IBD, after which the miner extends the
+  chain on its own, paying -genaddress.
+- The node shuts down cleanly with the miner thread running.
+"""
+import os
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    wait_until,
+)
+
+class MinerTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def run_test(self):
+        node = self.nodes[0]
+        address = node.decodescript('51')['p2sh']
+
+        self.log.info("Start the miner on a chain still in initial block download")
+        self.stop_node(0)
+        self.start_node(0, ["-gen", "-genproclimit=1", "-genaddress=%s" % address])
+        assert_equal(node.getblockchaininfo()['initialblockdownload'], True)
+        time.sleep(3)
+        assert_equal(node.getblockcount(), 0)
+
+        self.log.info("Leave IBD and wait for the miner to find blocks")
+        node.generatetoaddress(1, address)
+        assert_equal(node.getblockchaininfo()['initialblockdownload'], False)
+        wait_until(lambda: node.getblockcount() >= 3, timeout=60)
+        coinbase = node.getblock(node.getblockhash(2), 2)['tx'][0]
+        assert_equal(coinbase['vout'][0]['scriptPubKey']['addresses'], [address])
+
+        self.log.info("Stop the node while the miner is running")
+        self.stop_node(0)
+        with open(os.path.join(node.datadir, "regtest", "debug.log"), encoding="utf-8") as log:
+            assert log.read().rstrip().endswith("Shutdown: done")
+
+if __name__ == '__main__':
+    MinerTest().main()
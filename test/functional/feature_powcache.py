@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the on-disk PoW hash cache (-powcache) and getpowcacheinfo.
+
+- node0 runs with -powcache and mines blocks, which records their PoW hashes.
+- node1 runs without the cache and accepts the same blocks.
+- node0 reindexes, which finds every PoW hash on disk instead of hashing
+  the blocks again, and ends up on the same chain.
+"""
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than_or_equal,
+    wait_until,
+)
+
+BLOCKS = 20
+
+class PoWCacheTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [["-powcache"], []]
+
+    def check_hitrate(self, info):
+        lookups = info['hits'] + info['misses']
+        assert_equal(info['hitrate'], info['hits'] / lookups if lookups else 0)
+
+    def run_test(self):
+        node0, node1 = self.nodes
+
+        self.log.info("Only the node started with -powcache has it enabled")
+        assert_equal(node0.getpowcacheinfo()['enabled'], True)
+        assert_equal(node1.getpowcacheinfo(), {'enabled': False, 'hits': 0, 'misses': 0, 'hitrate': 0, 'size_on_disk': 0})
+
+        self.log.info("Mine blocks on the node with the cache")
+        address = node0.decodescript('51')['p2sh']
+        node0.generatetoaddress(BLOCKS, address)
+        self.sync_all()
+        assert_equal(node1.getbestblockhash(), node0.getbestblockhash())
+        info = node0.getpowcacheinfo()
+        assert_greater_than_or_equal(info['misses'], BLOCKS)
+        self.check_hitrate(info)
+        assert_equal(node1.getpowcacheinfo()['misses'], 0)
+
+        self.log.info("Reindexing reads the PoW hashes back from the cache")
+        self.stop_node(0)
+        self.start_node(0, ["-powcache", "-reindex"])
+        wait_until(lambda: node0.getblockcount() == BLOCKS, timeout=60)
+        assert_equal(node0.getbestblockhash(), node1.getbestblockhash())
+        info = node0.getpowcacheinfo()
+        assert_greater_than_or_equal(info['hits'], BLOCKS)
+        assert_equal(info['misses'], 0)
+        self.check_hitrate(info)
+
+        self.log.info("The cache is off again without -powcache")
+        self.stop_node(0)
+        self.start_node(0, [])
+        assert_equal(node0.getpowcacheinfo()['enabled'], False)
+        assert_equal(node0.getbestblockhash(), node1.getbestblockhash())
+
+if __name__ == '__main__':
+    PoWCacheTest().main()
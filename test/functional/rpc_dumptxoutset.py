@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018-2020 The Sugarchain Yumekawa developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the dumptxoutset RPC.
+
+- node0 mines blocks and writes a snapshot at its tip. The snapshot commits to
+  the same hash as gettxoutsetinfo.
+- node1 syncs the same blocks and writes a snapshot with the same hash.
+- An existing file is not overwritten.
+"""
+import os
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+
+class DumptxoutsetTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+
+    def run_test(self):
+        node0, node1 = self.nodes
+        address = node0.decodescript('51')['p2sh']
+        node0.generatetoaddress(100, address)
+        self.sync_all()
+
+        self.log.info("Write a snapshot at the tip")
+        snapshot = node0.dumptxoutset('utxo.dat')
+        info = node0.gettxoutsetinfo()
+        assert_equal(snapshot['base_height'], 100)
+        assert_equal(snapshot['base_hash'], node0.getbestblockhash())
+        assert_equal(snapshot['coins_written'], info['txouts'])
+        assert_equal(snapshot['hash_serialized_2'], info['hash_serialized_2'])
+        assert_equal(snapshot['path'], os.path.join(node0.datadir, 'regtest', 'utxo.dat'))
+        assert os.path.isfile(snapshot['path'])
+        assert not os.path.exists(snapshot['path'] + '.incomplete')
+
+        self.log.info("Another node at the same block writes the same set")
+        assert_equal(node1.dumptxoutset('utxo.dat')['hash_serialized_2'], snapshot['hash_serialized_2'])
+
+        self.log.info("Refuse to overwrite an existing file")
+        assert_raises_rpc_error(-8, 'already exists', node0.dumptxoutset, 'utxo.dat')
+
+if __name__ == '__main__':
+    DumptxoutsetTest().main()
@@ -102,6 +102,9 @@ BASE_SCRIPTS= [
     'p2p_disconnect_ban.py',
     'rpc_decodescript.py',
     'rpc_blockchain.py',
+    'rpc_dumptxoutset.py',
+    'feature_powcache.py',
+    'feature_miner.py',
     'rpc_deprecated.py',
     'wallet_disable.py',
     'rpc_net.py',